@@ -81,6 +81,64 @@ protected:
     }
 };
 
+// Growable output buffer, lets a BinaryWriter serialize straight into memory
+class MemoryWriteBuffer : public std::streambuf {
+public:
+    MemoryWriteBuffer() : std::streambuf() {}
+
+    std::vector<u8> mData;
+
+protected:
+    virtual std::streamsize xsputn(const char* pData, std::streamsize count) override {
+        u64 end = mPos + count;
+        if (end > mData.size())
+            mData.resize(end);
+
+        // Empty entries may not have a buffer at all
+        if (count)
+            memcpy(mData.data() + mPos, pData, count);
+        mPos = end;
+        return count;
+    }
+
+    virtual int_type overflow(int_type ch) override {
+        if (ch == traits_type::eof())
+            return traits_type::not_eof(ch);
+
+        char c = (char)ch;
+        xsputn(&c, 1);
+        return ch;
+    }
+
+    virtual pos_type seekoff(off_type off, std::ios_base::seekdir dir, std::ios_base::openmode which = std::ios_base::out) override {
+        if (which != std::ios_base::out) {
+            throw std::invalid_argument("memwritebuf::seekoff[which]");
+        }
+
+        off_type pos;
+        if (dir == std::ios_base::beg)
+            pos = off;
+        else if (dir == std::ios_base::cur)
+            pos = mPos + off;
+        else
+            pos = mData.size() + off;
+
+        if (pos < 0) {
+            throw std::out_of_range("memwritebuf::seekoff");
+        }
+
+        mPos = pos;
+        return pos;
+    }
+
+    virtual pos_type seekpos(pos_type pos, std::ios_base::openmode which = std::ios_base::out) override {
+        return seekoff(pos, std::ios_base::beg, which);
+    }
+
+private:
+    u64 mPos = 0;
+};
+
 namespace {
     template <typename T>
     void SwapEndian(T &val) {
@@ -144,6 +202,7 @@ class BinaryWriter {
 public:
     BinaryWriter(const std::string &, EndianSelect);
     BinaryWriter(const u8*, u32, EndianSelect);
+    BinaryWriter(EndianSelect);
     BinaryWriter() {}
     BinaryWriter(std::ostream* stream) : mStream(stream) {}
 
@@ -168,10 +227,12 @@ public:
     void align32();
 
     const u8* getBuffer();
+    std::vector<u8> &getData();
 
     EndianSelect mEndian;
 private:
     MemoryBuffer* mBuffer = nullptr;
+    MemoryWriteBuffer* mWriteBuffer = nullptr;
     std::ostream* mStream = nullptr;
 };
 
@@ -1,8 +1,10 @@
 #pragma once
 #include "BinaryReaderAndWriter.h"
 #include "JKRCompression.h"
+#include "JKRCompressionContext.h"
 #include <vector>
 #include <memory>
+#include <functional>
 
 // Heavily based off https://github.com/SunakazeKun/pygapa/blob/main/jsystem/jkrarchive.py
 
@@ -26,6 +28,11 @@ enum JKRPreloadType {
     JKRPreloadType_DVD = 2,
 };
 
+enum JKRWalkOrder {
+    JKRWalkOrder_DEPTH_FIRST,
+    JKRWalkOrder_BREADTH_FIRST,
+};
+
 struct JKRArchiveHeader {
     u32 mDVDFileSize;
     u32 mARAMSize;
@@ -99,17 +106,36 @@ public:
     std::string mName;
     u16 mNameOffs;
     std::shared_ptr<u8[]> mData;
+    // Payload mData was decompressed from, kept by JKRArchive::decompressEntries on request.
+    // Saving writes it back as it is, so it has to be reset whenever mData is replaced.
+    std::shared_ptr<u8[]> mCompressedData;
+    u32 mCompressedSize = 0;
 };
 
 class JKRArchive {
 public:
     JKRArchive() {}
     JKRArchive(const std::string &);
+    // Copies every file's data out of the buffer, it can be freed right away
     JKRArchive(u8*, u32);
+    // Takes over the buffer instead, file data points into it and keeps it alive for as long as it's used
+    JKRArchive(std::shared_ptr<u8[]>, u32);
 
     void unpack(const std::string &);
+    // Calls the visitor with the path and entry of everything in the archive, returning false stops the walk
+    void walk(const std::function<bool(const std::string &, const std::shared_ptr<JKRDirectory> &)> &, JKRWalkOrder = JKRWalkOrder_DEPTH_FIRST);
+    void decompressEntries(u32 = 0, bool = false);
     void save(const std::string &, bool, EndianSelect);
+    std::vector<u8> saveToMemory(bool, EndianSelect = Big);
     void importFromFolder(const std::string &, JKRFileAttr);
+    void createRoot(const std::string &);
+    // Adds a file at a path below the root like "folder/file.bin", creating missing folders on the way and replacing
+    // a file that's already there. The data is taken over without a copy: the vector's buffer is moved in and kept
+    // alive by the archive, the pointer one is only referenced and has to stay valid for as long as the archive is used.
+    // Files without a preload type in attr go to main RAM.
+    std::shared_ptr<JKRDirectory> addFile(const std::string &, std::vector<u8> &&, JKRFileAttr);
+    std::shared_ptr<JKRDirectory> addFile(const std::string &, std::shared_ptr<u8[]>, u32, JKRFileAttr);
+    std::shared_ptr<JKRDirectory> addFile(const std::string &, const u8 *, u32, JKRFileAttr);
     std::shared_ptr<JKRDirectory> createDir(const std::string &, JKRFileAttr, std::shared_ptr<JKRFolderNode>, std::shared_ptr<JKRFolderNode>);
     std::shared_ptr<JKRDirectory> createFile(const std::string &, std::shared_ptr<JKRFolderNode>, JKRFileAttr);
     std::shared_ptr<JKRFolderNode> createFolder(const std::string &, std::shared_ptr<JKRFolderNode>);
@@ -117,11 +143,15 @@ public:
     std::vector<std::shared_ptr<JKRFolderNode>> mFolderNodes;
     std::vector<std::shared_ptr<JKRDirectory>> mDirectories;
     std::shared_ptr<JKRFolderNode> mRoot = nullptr;
+    std::shared_ptr<JKRCompressionCache> mCompressionCache = nullptr;
+    s32 mCompressionLevel = JKRCompressionLevel_FAST;
+    // Shared by every compressed entry of this archive so the encoder tables are allocated once
+    std::shared_ptr<JKRCompressionContext> mCompressionContext = std::make_shared<JKRCompressionContext>();
 
-    void read(BinaryReader &);
+    void read(BinaryReader &, const std::shared_ptr<u8[]> & = nullptr, u32 = 0);
     void write(BinaryWriter &, bool);
 private:
-    void writeFileData(BinaryWriter &, std::vector<std::shared_ptr<JKRDirectory>>, u32 *);
+    void writeFileData(BinaryWriter &, std::vector<std::shared_ptr<JKRDirectory>>, u32, u32 *);
 
     void sortNodesAndDirs();
     void sortNodeAndDirs(std::shared_ptr<JKRFolderNode>);
@@ -146,3 +176,46 @@ private:
     bool mSyncFileIds = true;
     u16 mNextFileIdx = 0;
 };
+
+// Walks every entry below a folder, shortcuts excluded, yielding paths relative to that folder like "sub/file.bin".
+// The path is built in a buffer that's reused for the whole walk and folders are kept as plain pointers,
+// so stepping to the next entry doesn't allocate once the buffers have grown. Both the path and the entry
+// are only valid until the next call to next(), and the tree mustn't be changed during the walk.
+class JKRArchiveWalker {
+public:
+    JKRArchiveWalker(const JKRFolderNode *, JKRWalkOrder = JKRWalkOrder_DEPTH_FIRST);
+
+    bool next();
+    // Leaves out the contents of the folder next() just returned
+    void skipFolder() { mSkipFolder = true; }
+
+    const std::shared_ptr<JKRDirectory>& getEntry() const { return *mEntry; }
+    const std::string& getPath() const { return mPath; }
+    // 0 for entries directly inside the walked folder
+    u32 getDepth() const { return mDepth; }
+private:
+    struct Frame {
+        const JKRFolderNode* mFolder;
+        u32 mNextChild;
+        u32 mDepth;
+        // Where the folder's path starts, in mPath for depth first and in mFolderPaths for breadth first
+        u32 mPathOffs;
+        u32 mPathLength;
+    };
+
+    void enterFolder(const JKRFolderNode *, u32);
+
+    JKRWalkOrder mOrder;
+    std::vector<Frame> mFrames;
+    u32 mNextFrame = 0;
+    std::string mFolderPaths;
+    std::string mPath;
+    const std::shared_ptr<JKRDirectory>* mEntry = nullptr;
+    u32 mDepth = 0;
+    bool mSkipFolder = false;
+};
+
+// Patches a single file entry of an uncompressed archive on disk without rebuilding it
+namespace JKRArchivePatch {
+    bool replaceFile(const std::string &, const std::string &, const u8*, u32);
+};
@@ -0,0 +1,89 @@
+#pragma once
+
+#include <string_view>
+#include "types.h"
+#include "JKRArchive.h"
+
+// Payload of an entry, pointing into the image the view was opened on
+struct JKRArchiveSpan {
+    const u8* mData = nullptr;
+    u32 mSize = 0;
+
+    const u8* begin() const { return mData; }
+    const u8* end() const { return mData + mSize; }
+    u32 size() const { return mSize; }
+    bool empty() const { return mSize == 0; }
+};
+
+// Read-only view of a RARC/CRAR image in memory, e.g. a mapped file. Opening only checks the headers and
+// that the node tables fit, nothing is copied or allocated and every accessor reads the image in place.
+// Offsets inside nodes are checked when they're used, broken ones give invalid handles and empty spans.
+// The image has to outlive the view and everything obtained from it.
+class JKRArchiveView {
+public:
+    class Folder;
+
+    // Handle to a file or folder entry, cheap to copy
+    class Entry {
+    public:
+        bool isValid() const { return mNode != nullptr; }
+        std::string_view getName() const;
+        u16 getId() const;
+        JKRFileAttr getAttr() const;
+        bool isFile() const { return getAttr() & JKRFileAttr_FILE; }
+        bool isFolder() const { return getAttr() & JKRFileAttr_FOLDER; }
+        // The "." and ".." entries every folder has
+        bool isShortcut() const;
+
+        // Raw payload of a file, still Yaz0/Yay0 when the entry is compressed
+        JKRArchiveSpan getData() const;
+        // Folder a folder entry stands for
+        Folder getFolder() const;
+    private:
+        friend class JKRArchiveView;
+        const JKRArchiveView* mView = nullptr;
+        const u8* mNode = nullptr;
+    };
+
+    class Folder {
+    public:
+        bool isValid() const { return mNode != nullptr; }
+        std::string_view getName() const;
+        u32 getEntryCount() const;
+        Entry getEntry(u32) const;
+        // Case-insensitive lookup of a direct child, shortcuts excluded
+        Entry find(std::string_view) const;
+    private:
+        friend class JKRArchiveView;
+        const JKRArchiveView* mView = nullptr;
+        const u8* mNode = nullptr;
+    };
+
+    bool open(const u8 *, u32);
+    bool isOpen() const { return mData != nullptr; }
+
+    u32 getFolderCount() const { return mFolderCount; }
+    u32 getEntryCount() const { return mEntryCount; }
+    Folder getFolder(u32) const;
+    Folder getRoot() const { return getFolder(0); }
+    Entry getEntry(u32) const;
+    // Looks up a path like "folder/file.bin", with or without the root folder's name in front
+    Entry find(std::string_view) const;
+private:
+    u32 readU32(const u8 *) const;
+    u16 readU16(const u8 *) const;
+    std::string_view readName(u32) const;
+    Entry findFrom(Folder, std::string_view) const;
+
+    const u8* mData = nullptr;
+    bool mLittleEndian = false;
+
+    const u8* mFolders = nullptr;
+    u32 mFolderCount = 0;
+    const u8* mEntries = nullptr;
+    u32 mEntryCount = 0;
+    const u8* mStrings = nullptr;
+    u32 mStringTableSize = 0;
+    const u8* mFileData = nullptr;
+    u32 mFileDataSize = 0;
+};
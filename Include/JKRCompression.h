@@ -2,6 +2,10 @@
 
 #include <string>
 #include "BinaryReaderAndWriter.h"
+#include "JKRCompressionCache.h"
+
+class JKRSZSGroupWriter;
+class JKRCompressionContext;
 
 enum JKRCompressionType {
     JKRCompressionType_NONE = 0x0,
@@ -10,16 +14,55 @@ enum JKRCompressionType {
     JKRCompressionType_ASR = 0x3
 };
 
+// Input split used by the multithreaded encoder, part of what determines its output
+const u32 cSZSSegmentSize = 0x100000;
+
+// Speed/size trade-off of the encoders, measured with -b on a single desktop core over a 2.2 MB mix of
+// C source (250 KB), an x86-64 executable (1.3 MB) and float model data (720 KB). Sizes are relative to level 9.
+// The 4 KB window bounds the hash chains, searching deeper than 256 hardly finds anything new, so the lazy
+// levels stop there and level 8 searches the whole window. Small or very repetitive inputs saturate earlier.
+//   level  parse   chain depth  size     speed
+//   0      store   -            +200%    ~930 MB/s (Yaz0 framing only, input + 1/8)
+//   1      greedy  1            +18.0%   ~110 MB/s
+//   2      greedy  4            +10.9%   ~90 MB/s (-f, per-file szs default)
+//   3      greedy  16           +7.5%    ~90 MB/s
+//   4      lazy    32           +3.0%    ~50 MB/s
+//   5      lazy    64           +2.0%    ~35 MB/s
+//   6      lazy    128          +1.1%    ~34 MB/s (default)
+//   7      lazy    256          +0.7%    ~29 MB/s
+//   8      lazy    4096         +0.6%    ~17 MB/s (exhaustive search of the 4 KB window)
+//   9      optimal suffix array smallest ~5 MB/s (hash chains of depth 4096 give the same size at ~1.5 MB/s)
+enum JKRCompressionLevel {
+    JKRCompressionLevel_STORE = 0,
+    JKRCompressionLevel_FAST = 2,
+    JKRCompressionLevel_DEFAULT = 6,
+    JKRCompressionLevel_MAX = 9
+};
+
 namespace JKRCompression {
     JKRCompressionType checkCompression(const std::string &);
+    JKRCompressionType checkCompression(const u8*, u32, bool = true);
     u8* decode(const std::string &, u32 *);
-    void encode(const std::string &, JKRCompressionType, bool);
+    u8* decodeFile(const std::string &, u32 *, JKRCompressionType *, u32 = 0);
+    u8* decode(const u8*, u32, u32 *);
+    bool isWorthCompressing(const u8*, u32, JKRCompressionContext* = nullptr);
+    std::string getCacheEncoderName(JKRCompressionType, s32, const JKRCompressionContext *);
+    void encode(const std::string &, JKRCompressionType, s32 = JKRCompressionLevel_DEFAULT, JKRCompressionCache* = nullptr, u32 = 0, JKRCompressionContext* = nullptr);
+    void encode(const std::string &, u8*, u32, JKRCompressionType, s32 = JKRCompressionLevel_DEFAULT, JKRCompressionCache* = nullptr, u32 = 0, JKRCompressionContext* = nullptr);
 
     u8* decodeSZS(const u8*, u32);
+    u8* tryDecodeSZS(const u8*, u32, u32 *);
+    u8* decodeSZSFile(const std::string &, u32 *);
+    u8* decodeSZSStream(std::ifstream &, std::vector<u8> &, u32, u32 *);
+    bool decodeSZSRange(const u8*, const u8*, u8*, u32, u32);
     u8* decodeSZP(const u8*, u32);
-    u32 encodeSimpleSZS(u8 *, s32, s32, u32 *);
-    u32 encodeAdvancedSZS(u8 *, s32, s32, u32 *);
-    const u8* encodeSZS(u8*, u32, u32 *);
+    u8* tryDecodeSZP(const u8*, u32, u32 *);
+    const u8* encodeSZS(u8*, u32, u32 *, s32 = JKRCompressionLevel_DEFAULT, bool = false, JKRCompressionContext* = nullptr);
     const u8* encodeSZSFast(u8*, u32, u32 *);
-    void encodeSZP(const std::string &);
+    void encodeSZSFile(const std::string &, const u8*, u32, s32 = JKRCompressionLevel_DEFAULT, JKRCompressionContext* = nullptr);
+    const u8* encodeSZSParallel(u8*, u32, u32 *, s32 = JKRCompressionLevel_DEFAULT, u32 = 0, u32 = cSZSSegmentSize, JKRCompressionContext* = nullptr, bool = false);
+    const u8* encodeSZSOptimal(u8*, u32, u32 *);
+    void encodeSZSBlock(const u8*, u32, u32, s32, JKRSZSGroupWriter &, JKRCompressionContext &);
+    const u8* encodeSZP(u8*, u32, u32 *, s32 = JKRCompressionLevel_DEFAULT, u32 = 0, u32 = cSZSSegmentSize, JKRCompressionContext* = nullptr, bool = false);
+    const u8* encodeWithBudget(u8*, u32, u32 *, JKRCompressionType, double, u32 = 0, u32 = 0, JKRCompressionContext* = nullptr);
 };
\ No newline at end of file
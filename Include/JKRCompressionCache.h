@@ -0,0 +1,30 @@
+#pragma once
+
+#include <string>
+#include "types.h"
+
+// Persistent on-disk store of compressed payloads, keyed by (content hash, encoder, level).
+// Entries are published with an atomic rename so several processes can share one directory,
+// and the least recently used entries are evicted once the directory grows past its limit.
+class JKRCompressionCache {
+public:
+    JKRCompressionCache(const std::string &, u64);
+
+    u8* load(const u8*, u32, const std::string &, s32, u32 *);
+    void store(const u8*, u32, const std::string &, s32, const u8*, u32);
+    void evict();
+
+    std::string mDirectory;
+    u64 mMaxSize;
+private:
+    struct Key {
+        u64 mHashLo;
+        u64 mHashHi;
+        u32 mSize;
+    };
+
+    Key makeKey(const u8*, u32);
+    std::string getEntryPath(const Key &, const std::string &, s32);
+
+    u64 mApproxSize = 0;
+};
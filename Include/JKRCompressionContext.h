@@ -0,0 +1,47 @@
+#pragma once
+
+#include <vector>
+#include <chrono>
+#include "types.h"
+#include "JKRMatchFinder.h"
+#include "JKRSuffixMatchFinder.h"
+
+// Match finder behind the optimal parse of level 9, the other levels always use hash chains
+enum JKRMatchFinderType {
+    JKRMatchFinderType_HASH_CHAIN = 0x0,
+    JKRMatchFinderType_SUFFIX_ARRAY = 0x1
+};
+
+// Working state of one Yaz0/Yay0 encoder. Calls that run at the same time each need their own,
+// and reusing one across calls keeps the match finder tables and scratch buffers allocated.
+class JKRCompressionContext {
+public:
+    JKRMatchFinder mFinder;
+    JKRSuffixMatchFinder mSuffixFinder;
+    JKRMatchFinderType mFinderType = JKRMatchFinderType_SUFFIX_ARRAY;
+    // Extra cost in bits of every match token. Each match is a branch and a copy for the decoder while
+    // literal runs are copied 8 bytes at a time, so a penalty trades a little size for faster loading
+    // by dropping short matches in favour of literals and longer copies. 0 optimises for size alone.
+    u32 mMatchPenalty = 0;
+    // The parsers give up once this passes, whatever they wrote by then is incomplete and has to be dropped
+    std::chrono::steady_clock::time_point mDeadline = std::chrono::steady_clock::time_point::max();
+    // Set by a parser that gave up on the deadline, only then is the output of the call incomplete
+    bool mAbandoned = false;
+
+    // Per-position match info and costs of the optimal parse, grown on demand
+    std::vector<u16> mLengths;
+    std::vector<u16> mBacks;
+    std::vector<u16> mChoices;
+    std::vector<u32> mCosts;
+
+    bool isPastDeadline() const {
+        return mDeadline != std::chrono::steady_clock::time_point::max() && std::chrono::steady_clock::now() >= mDeadline;
+    }
+
+    // What the contexts of worker threads take over from the caller's
+    void copySettings(const JKRCompressionContext &other) {
+        mFinderType = other.mFinderType;
+        mMatchPenalty = other.mMatchPenalty;
+        mDeadline = other.mDeadline;
+    }
+};
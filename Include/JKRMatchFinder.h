@@ -0,0 +1,32 @@
+#pragma once
+
+#include <vector>
+#include "types.h"
+
+// Back-reference limits shared by Yaz0 and Yay0
+const u32 cSZSWindowSize = 0x1000;
+const u32 cSZSMinMatch = 0x3;
+const u32 cSZSMaxMatch = 0x111;
+
+// Hash-chain match finder over the 4 KB Yaz0/Yay0 window.
+// Every position has to be inserted exactly once and in order, findMatch only sees inserted positions.
+class JKRMatchFinder {
+public:
+    JKRMatchFinder();
+
+    void reset(const u8 *, u32);
+    void insert(u32);
+    u32 findMatch(u32, u32 *);
+
+    static u32 getMatchLength(const u8 *, const u8 *, u32);
+
+    u32 mChainDepth;
+    u32 mNiceLength;
+private:
+    u32 hash(u32);
+
+    const u8* mSrc = nullptr;
+    u32 mSize = 0;
+    std::vector<s32> mHead;
+    std::vector<s32> mPrev;
+};
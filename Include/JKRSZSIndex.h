@@ -0,0 +1,46 @@
+#pragma once
+
+#include <string>
+#include <vector>
+#include "types.h"
+#include "JKRMatchFinder.h"
+
+// Distance between checkpoints in decompressed bytes
+const u32 cSZSIndexInterval = 0x40000;
+
+// A place in a Yaz0 stream decoding can start from. Checkpoints always sit on a group header,
+// so the flag bit position is implicitly 0 and only the offsets and history are needed.
+struct JKRSZSCheckpoint {
+    u32 mCompOffs;
+    u32 mDecompOffs;
+    // Hash of the compressed span up to the next checkpoint or the end of the file,
+    // catches a sidecar that no longer matches its file
+    u32 mCheck;
+    // The up to 4 KB of output in front of mDecompOffs
+    std::vector<u8> mWindow;
+};
+
+// Random-access index over a Yaz0 stream, kept in a sidecar file next to it. Any range can be decoded
+// starting from the nearest checkpoint, and the spans between checkpoints decode independently.
+class JKRSZSIndex {
+public:
+    bool build(const u8 *, u32, const u8 * = nullptr, u32 = cSZSIndexInterval);
+    bool load(const std::string &);
+    void save(const std::string &);
+
+    u8* decodeRange(const u8 *, u32, u32, u32);
+    u8* decodeRange(const std::string &, u32, u32);
+    u8* decodeParallel(const u8 *, u32, u32 = 0);
+
+    static std::string getSidecarPath(const std::string &);
+
+    u32 mCompSize = 0;
+    u32 mDecompSize = 0;
+    std::vector<JKRSZSCheckpoint> mCheckpoints;
+private:
+    bool findSpans(u32, u32, u32 *, u32 *);
+    u32 getSpanEnd(u32);
+    u8* decodeSlice(const u8 *, u32, u32, u32, u32);
+    bool decodeSpan(const u8 *, u32, u32, u32, u32, std::vector<u8> &);
+    static u32 hashSpan(const u8 *, u32);
+};
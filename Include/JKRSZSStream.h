@@ -0,0 +1,171 @@
+#pragma once
+
+#include <string.h>
+#include <vector>
+#include "types.h"
+#include "JKRMatchFinder.h"
+#include "JKRCompression.h"
+#include "JKRCompressionContext.h"
+
+enum JKRStreamStatus {
+    JKRStreamStatus_NEED_INPUT = 0x0,
+    JKRStreamStatus_NEED_OUTPUT = 0x1,
+    JKRStreamStatus_DONE = 0x2,
+    JKRStreamStatus_ERROR = 0x3
+};
+
+// Packs literals and back-references into Yaz0 groups, one flag bit per token
+class JKRSZSGroupWriter {
+public:
+    JKRSZSGroupWriter(u8 *pDst) : mDst(pDst) {}
+
+    void writeLiteral(u8 val) {
+        beginToken();
+        mDst[mGroupPos] |= 0x80 >> mBitCount;
+        mDst[mPos++] = val;
+        endToken();
+    }
+
+    void writeMatch(u32 back, u32 length) {
+        beginToken();
+        u32 dist = back - 1;
+
+        if (length >= 0x12) {
+            mDst[mPos++] = dist >> 8;
+            mDst[mPos++] = dist & 0xFF;
+            mDst[mPos++] = length - 0x12;
+        }
+        else {
+            mDst[mPos++] = ((length - 2) << 4) | (dist >> 8);
+            mDst[mPos++] = dist & 0xFF;
+        }
+        endToken();
+    }
+
+    // Appends another writer's output. It's copied verbatim when this writer is on a group boundary,
+    // otherwise every token has to be re-packed into the shifted groups.
+    void append(const JKRSZSGroupWriter &other) {
+        if (mBitCount == 0) {
+            memcpy(mDst + mPos, other.mDst, other.mPos);
+            mGroupPos = mPos + other.mGroupPos;
+            mBitCount = other.mBitCount;
+            mPos += other.mPos;
+            return;
+        }
+
+        const u8* src = other.mDst;
+        u32 pos = 0;
+        while (pos < other.mPos) {
+            u8 header = src[pos++];
+
+            for (u32 bit = 0; bit < 8 && pos < other.mPos; bit++) {
+                if (header & (0x80 >> bit)) {
+                    writeLiteral(src[pos++]);
+                    continue;
+                }
+
+                u8 byte1 = src[pos++];
+                u8 byte2 = src[pos++];
+                u32 back = (((byte1 & 0xF) << 8) | byte2) + 1;
+                u32 length = (byte1 >> 4) ? (byte1 >> 4) + 2 : src[pos++] + 0x12;
+                writeMatch(back, length);
+            }
+        }
+    }
+
+    // Everything before the group that is still being filled can no longer change
+    u32 getFinishedSize() const {
+        return mBitCount ? mGroupPos : mPos;
+    }
+
+    // Drops the finished bytes and moves the open group to the front of the buffer
+    void dropFinished() {
+        u32 size = getFinishedSize();
+        memmove(mDst, mDst + size, mPos - size);
+        mPos -= size;
+        mGroupPos = 0;
+    }
+
+    u8* mDst;
+    u32 mPos = 0;
+private:
+    void beginToken() {
+        if (mBitCount == 0) {
+            mGroupPos = mPos++;
+            mDst[mGroupPos] = 0;
+        }
+    }
+
+    void endToken() {
+        mBitCount = (mBitCount + 1) & 7;
+    }
+
+    u32 mGroupPos = 0;
+    u32 mBitCount = 0;
+};
+
+// Resumable Yaz0 decoder. Input may arrive in chunks of any size and output goes into caller buffers,
+// the only history kept is the 4 KB window back-references can reach.
+class JKRSZSDecoder {
+public:
+    JKRSZSDecoder();
+
+    void reset();
+    JKRStreamStatus decode(const u8 *, u32, u32 *, u8 *, u32, u32 *);
+
+    bool hasHeader() const { return mHeaderSize == 0x10; }
+    u32 getDecompressedSize() const { return mDecompSize; }
+private:
+    u8 mHeader[0x10];
+    u32 mHeaderSize;
+    u32 mDecompSize;
+    u32 mOutPos;
+
+    u8 mFlags;
+    u32 mFlagBits;
+    u8 mToken[3];
+    u32 mTokenSize;
+    u32 mCopyDist;
+    u32 mCopyLeft;
+    bool mFailed;
+
+    u8 mWindow[cSZSWindowSize];
+};
+
+// Push-style Yaz0 encoder. Input is buffered until a block is full, the block is compressed against
+// the 4 KB before it and the finished groups become readable. Memory stays at about two blocks no
+// matter how long the stream is, and the output equals encodeSZSParallel with the same segment size.
+// The header carries the size given up front, if it isn't known yet pass 0 and patch it afterwards.
+// Settings like the match finder and penalty are taken over from the context passed in. Once its deadline
+// passes the blocks left are cut short, check isAbandoned after finish and drop such a stream.
+class JKRSZSEncoder {
+public:
+    JKRSZSEncoder(u32, s32 = JKRCompressionLevel_DEFAULT, u32 = cSZSSegmentSize, JKRCompressionContext* = nullptr);
+
+    void write(const u8 *, u32);
+    void finish();
+    u32 read(u8 *, u32);
+
+    u32 getPendingSize() const { return mOutput.size() - mOutputPos; }
+    u32 getTotalIn() const { return mTotalIn; }
+    bool isAbandoned() const { return mContext.mAbandoned; }
+
+    static void patchHeader(u8 *, u32);
+private:
+    void encodeBlock(u32);
+
+    s32 mLevel;
+    u32 mBlockSize;
+    u32 mTotalIn = 0;
+    bool mFinished = false;
+
+    // Input still to compress, preceded by up to 4 KB of history
+    std::vector<u8> mInput;
+    u32 mHistorySize = 0;
+
+    JKRCompressionContext mContext;
+    std::vector<u8> mScratch;
+    JKRSZSGroupWriter mWriter;
+    std::vector<u8> mOutput;
+    u32 mOutputPos = 0;
+};
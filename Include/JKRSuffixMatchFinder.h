@@ -0,0 +1,42 @@
+#pragma once
+
+#include <vector>
+#include "types.h"
+#include "JKRMatchFinder.h"
+
+// Match finder built on a suffix array with LCP, a drop-in for JKRMatchFinder in the optimal parse.
+// The input is indexed a block at a time together with the 4 KB before it, and the longest match of
+// every position in the block is looked up right away by walking the suffix array to the nearest
+// neighbour inside the window. Unlike hash chains its cost doesn't grow with how repetitive the data is.
+// Positions have to be queried in increasing order, insert is only there to match JKRMatchFinder.
+class JKRSuffixMatchFinder {
+public:
+    JKRSuffixMatchFinder();
+
+    void reset(const u8 *, u32);
+    void insert(u32) {}
+    u32 findMatch(u32, u32 *);
+
+    u32 mBlockSize;
+    // Suffixes visited per direction before giving up on a window neighbour
+    u32 mMaxSteps;
+private:
+    void buildBlock(u32);
+    void buildSuffixArray(u32);
+    void buildLCP(u32);
+
+    const u8* mSrc = nullptr;
+    u32 mSize = 0;
+    u32 mBlockStart = 0;
+    u32 mBlockEnd = 0;
+    u32 mTextStart = 0;
+
+    std::vector<s32> mSuffixes;
+    std::vector<s32> mRanks;
+    std::vector<s32> mLCP;
+    std::vector<s32> mScratch;
+    std::vector<s32> mCounts;
+
+    std::vector<u16> mLengths;
+    std::vector<u16> mBacks;
+};
@@ -53,30 +53,13 @@ std::string BinaryReader::readNullTerminatedStringAt(const u32 &rPos) {
 }
 
 u8* BinaryReader::readBytes(const u32 &count, EndianSelect select) {
-    if (mEndian == EndianSelect::Big && select == EndianSelect::Big) {
-        u32 curPos = position();
-        seek(curPos + (count - 1), std::ios::beg);
-        u8* output = new u8[count];
-
-        for (s32 i = 0; i < count; i++) {
-            output[i] = read<u8>();
-            seek(position() - 2, std::ios::beg);
-        }
-        
-        seek(curPos + count, std::ios::beg);
-        return output;
-    }
-    else {
-        u8* output = new u8[count];
+    u8* output = new u8[count];
+    mStream->read((char*)output, count);
 
-        for (s32 i = 0; i < count; i++) {
-            output[i] = read<u8>();
-        }
+    if (mEndian == EndianSelect::Big && select == EndianSelect::Big)
+        std::reverse(output, output + count);
 
-        return output;
-    }
-
-    return nullptr;
+    return output;
 }
 
 u8* BinaryReader::readAllBytes() {
@@ -117,11 +100,20 @@ BinaryWriter::BinaryWriter(const u8*pBuffer, u32 size, EndianSelect endian) {
     mEndian = endian;
 }
 
+BinaryWriter::BinaryWriter(EndianSelect endian) {
+    mWriteBuffer = new MemoryWriteBuffer();
+    mStream = new std::ostream(mWriteBuffer);
+    mEndian = endian;
+}
+
 BinaryWriter::~BinaryWriter() {
     delete mStream;
 
     if (mBuffer)
         delete mBuffer;
+
+    if (mWriteBuffer)
+        delete mWriteBuffer;
 }
 
 void BinaryWriter::writeString(const std::string &Str) {
@@ -134,15 +126,12 @@ void BinaryWriter::writeNullTerminatedString(const std::string &Str) {
 }
 
 void BinaryWriter::writeBytes(const u8 *bytes, u32 amount) {
-    for (s32 i = 0; i < amount; i++) {
-        write<u8>(bytes[i]);
-    }
+    mStream->write(reinterpret_cast<const char*>(bytes), amount);
 }
 
 void BinaryWriter::writePadding(u8 value, u32 amount) {
-    for (s32 i = 0; i < amount; i++) {
-        write<u8>(value);
-    }
+    std::vector<char> padding(amount, value);
+    mStream->write(padding.data(), amount);
 }
 
 void BinaryWriter::seek(u32 pos, std::ios::seekdir dir) {
@@ -170,9 +159,16 @@ void BinaryWriter::align32() {
 }
 
 const u8* BinaryWriter::getBuffer() {
+    if (mWriteBuffer)
+        return mWriteBuffer->mData.data();
+
     return mBuffer->mBuffer;
 }
 
+std::vector<u8> &BinaryWriter::getData() {
+    return mWriteBuffer->mData;
+}
+
 StringPool::StringPool(StringPoolFormat format) {
     mFormat = format;
     mLookUp = true;
@@ -1,6 +1,8 @@
 #include "..\Include\JKRArchive.h"
 #include "..\Include\Util.h"
 #include "..\Include\filesystem.hpp"
+#include <thread>
+#include <atomic>
 
 JKRArchive::JKRArchive(const std::string &filePath) {
     BinaryReader reader(filePath, EndianSelect::Big);
@@ -12,11 +14,22 @@ JKRArchive::JKRArchive(u8*pData, u32 size) {
     read(reader);
 }
 
+JKRArchive::JKRArchive(std::shared_ptr<u8[]> data, u32 size) {
+    BinaryReader reader(data.get(), size, EndianSelect::Big);
+    read(reader, data, size);
+}
+
 void JKRArchive::save(const std::string &filePath, bool reduceStrings, EndianSelect select = Big) {
     BinaryWriter writer(filePath, select);
     write(writer, reduceStrings);
 }
 
+std::vector<u8> JKRArchive::saveToMemory(bool reduceStrings, EndianSelect select) {
+    BinaryWriter writer(select);
+    write(writer, reduceStrings);
+    return std::move(writer.getData());
+}
+
 void JKRArchive::unpack(const std::string &filePath) {
     std::string fullpath;
     fullpath = filePath + "/" + mRoot->mName;
@@ -24,21 +37,167 @@ void JKRArchive::unpack(const std::string &filePath) {
     mRoot->unpack(fullpath);
 }
 
+void JKRArchive::walk(const std::function<bool(const std::string &, const std::shared_ptr<JKRDirectory> &)> &visitor, JKRWalkOrder order) {
+    if (!mRoot)
+        return;
+
+    JKRArchiveWalker walker(mRoot.get(), order);
+    while (walker.next()) {
+        if (!visitor(walker.getPath(), walker.getEntry()))
+            return;
+    }
+}
+
+// Replaces the data of every entry flagged as compressed with its decompressed form, spread over a pool of threads.
+// With keepCompressed the original payload stays with the entry, saving writes it back unchanged and unpacking writes it
+// next to the decompressed file. Otherwise it's dropped and saving compresses the entry again as its attributes say.
+// Entries that don't decode are left untouched.
+void JKRArchive::decompressEntries(u32 threadCount, bool keepCompressed) {
+    std::vector<std::shared_ptr<JKRDirectory>> entries;
+    for (auto dir : mDirectories) {
+        JKRCompressionType type = JKRCompression::checkCompression(dir->mData.get(), dir->mNode.mDataSize, false);
+        if (dir->getCompressionType() != JKRCompressionType_NONE && dir->mNode.mDataSize >= 0x10 && (type == JKRCompressionType_SZS || type == JKRCompressionType_SZP))
+            entries.push_back(dir);
+    }
+
+    if (threadCount == 0)
+        threadCount = std::max<u32>(1, std::thread::hardware_concurrency());
+
+    // Workers only ever touch their own entry, broken ones are reported once they're all done
+    std::vector<u8> failed(entries.size(), 0);
+    std::atomic<u32> nextEntry(0);
+    auto worker = [&]() {
+        for (u32 i = nextEntry++; i < entries.size(); i = nextEntry++) {
+            auto dir = entries[i];
+            const u8* pData = dir->mData.get();
+            u32 size;
+            u8* pDecoded;
+
+            if (JKRCompression::checkCompression(pData, dir->mNode.mDataSize, false) == JKRCompressionType_SZS)
+                pDecoded = JKRCompression::tryDecodeSZS(pData, dir->mNode.mDataSize, &size);
+            else
+                pDecoded = JKRCompression::tryDecodeSZP(pData, dir->mNode.mDataSize, &size);
+
+            if (!pDecoded) {
+                failed[i] = 1;
+                continue;
+            }
+
+            if (keepCompressed) {
+                dir->mCompressedData = dir->mData;
+                dir->mCompressedSize = dir->mNode.mDataSize;
+            }
+            dir->mData = std::shared_ptr<u8[]>(pDecoded);
+            dir->mNode.mDataSize = size;
+        }
+    };
+
+    std::vector<std::thread> threads;
+    for (u32 i = 1; i < std::min<u32>(threadCount, entries.size()); i++)
+        threads.emplace_back(worker);
+    worker();
+    for (auto &thread : threads)
+        thread.join();
+
+    for (u32 i = 0; i < entries.size(); i++) {
+        if (failed[i])
+            printf("Warning! %s is corrupt, leaving it compressed\n", entries[i]->mName.c_str());
+    }
+}
+
 void JKRArchive::importFromFolder(const std::string &filePath, JKRFileAttr attr) {
     if (!mRoot) {
         u32 lastSlashIdx = filePath.rfind('\\');
-        std::string name = filePath.substr(lastSlashIdx + 1);
-        mRoot = std::make_shared<JKRFolderNode>();
-        mRoot->mIsRoot = true;
-        mRoot->mName = name;
-        mFolderNodes.push_back(mRoot);
-        createDir(".", JKRFileAttr_FOLDER, mRoot, mRoot);
-        createDir("..", JKRFileAttr_FOLDER, nullptr, mRoot);
+        createRoot(filePath.substr(lastSlashIdx + 1));
     }
 
     importNode(filePath, mRoot, attr);
 }
 
+void JKRArchive::createRoot(const std::string &name) {
+    mRoot = std::make_shared<JKRFolderNode>();
+    mRoot->mIsRoot = true;
+    mRoot->mName = name;
+    mFolderNodes.push_back(mRoot);
+    createDir(".", JKRFileAttr_FOLDER, mRoot, mRoot);
+    createDir("..", JKRFileAttr_FOLDER, nullptr, mRoot);
+}
+
+std::shared_ptr<JKRDirectory> JKRArchive::addFile(const std::string &filePath, std::vector<u8> &&data, JKRFileAttr attr) {
+    // The entry aliases the vector's storage and shares ownership of the vector itself
+    auto buffer = std::make_shared<std::vector<u8>>(std::move(data));
+    return addFile(filePath, std::shared_ptr<u8[]>(buffer, buffer->data()), buffer->size(), attr);
+}
+
+std::shared_ptr<JKRDirectory> JKRArchive::addFile(const std::string &filePath, const u8 *pData, u32 size, JKRFileAttr attr) {
+    // Aliasing an empty pointer gives one that owns nothing, saving only ever reads entry data
+    return addFile(filePath, std::shared_ptr<u8[]>(std::shared_ptr<u8[]>(), (u8*)pData), size, attr);
+}
+
+std::shared_ptr<JKRDirectory> JKRArchive::addFile(const std::string &filePath, std::shared_ptr<u8[]> data, u32 size, JKRFileAttr attr) {
+    if (attr & JKRFileAttr_FOLDER) {
+        printf("Fatal error! %s can't be added with folder attributes\n", filePath.c_str());
+        return nullptr;
+    }
+
+    // Saving only writes the data of files with a preload type, like the packer they default to main RAM
+    attr = (JKRFileAttr)(attr | JKRFileAttr_FILE);
+    if (!(attr & (JKRFileAttr_LOAD_TO_MRAM | JKRFileAttr_LOAD_TO_ARAM | JKRFileAttr_LOAD_FROM_DVD)))
+        attr = (JKRFileAttr)(attr | JKRFileAttr_LOAD_TO_MRAM);
+
+    if (!mRoot)
+        createRoot("root");
+
+    std::vector<std::string> path;
+    std::string part;
+    for (char c : filePath + "/") {
+        if (c == '/' || c == '\\') {
+            if (!part.empty())
+                path.push_back(part);
+            part.clear();
+        }
+        else
+            part.push_back(c);
+    }
+
+    if (path.empty()) {
+        printf("Fatal error! %s is not a valid file path\n", filePath.c_str());
+        return nullptr;
+    }
+
+    std::shared_ptr<JKRFolderNode> folder = mRoot;
+    std::shared_ptr<JKRDirectory> file = nullptr;
+
+    for (u32 i = 0; i < path.size(); i++) {
+        bool isLast = i == path.size() - 1;
+        std::shared_ptr<JKRDirectory> found = nullptr;
+
+        for (auto dir : folder->mChildDirs) {
+            if (!dir->isShortcut() && !strcasecmp(dir->mName.c_str(), path[i].c_str())) {
+                found = dir;
+                break;
+            }
+        }
+
+        if (found && (isLast ? !found->isFile() : !found->isDirectory())) {
+            printf("Fatal error! %s is in the way of %s\n", found->mName.c_str(), filePath.c_str());
+            return nullptr;
+        }
+
+        if (isLast)
+            file = found ? found : createFile(path[i], folder, attr);
+        else
+            folder = found ? found->mFolderNode : createFolder(path[i], folder);
+    }
+
+    file->mAttr = attr;
+    file->mData = data;
+    file->mNode.mDataSize = size;
+    file->mCompressedData = nullptr;
+    file->mCompressedSize = 0;
+    return file;
+}
+
 void JKRArchive::importNode(const std::string &filepath, std::shared_ptr<JKRFolderNode> pParentNode, JKRFileAttr attr) {
     ghc::filesystem::directory_iterator iter(filepath);
     for (const auto& entry : iter) {
@@ -48,14 +207,10 @@ void JKRArchive::importNode(const std::string &filepath, std::shared_ptr<JKRFold
             continue;
         if (ghc::filesystem::is_directory(path)) {
             std::shared_ptr<JKRFolderNode> node = createFolder(name, pParentNode);
-            std::string np = (path / name).string();
-            importNode(np, node, attr);
+            importNode(path.string(), node, attr);
         } else if (ghc::filesystem::is_regular_file(path)) {
             auto node = createFile(name, pParentNode, attr);
-            u8* ptr = File::readAllBytes(path.string(), &node->mNode.mDataSize);
-            node->mData = std::shared_ptr<u8[]>(new u8[node->mNode.mDataSize]);
-            memcpy(node->mData.get(), ptr, node->mNode.mDataSize);
-            delete [] ptr;
+            node->mData = std::shared_ptr<u8[]>(File::readAllBytes(path.string(), &node->mNode.mDataSize));
         }
     }
 }
@@ -95,7 +250,8 @@ std::shared_ptr<JKRFolderNode> JKRArchive::createFolder(const std::string &folde
     return newFolder;
 }
 
-void JKRArchive::read(BinaryReader &reader) {
+// With the whole image at hand file data aliases it, otherwise it's read out of the stream
+void JKRArchive::read(BinaryReader &reader, const std::shared_ptr<u8[]> &image, u32 imageSize) {
     auto magic = reader.readString(0x4);
     if (magic != "RARC" && magic != "CRAR") {
         printf("Fatal error! File is not a valid JKRArchive");
@@ -147,13 +303,16 @@ void JKRArchive::read(BinaryReader &reader) {
                 dir->mFolderNode->mDirectory = dir;
         }
         else if (dir->isFile()) {
-            u32 curPos = reader.position();
-            reader.seek(mHeader.mFileDataOffset + mHeader.mHeaderSize + dir->mNode.mData, std::ios::beg);
-            u8* pData = reader.readBytes(dir->mNode.mDataSize, EndianSelect::Little);
-            reader.seek(curPos, std::ios::beg);     
-            dir->mData = std::shared_ptr<u8[]>(new u8[dir->mNode.mDataSize]);
-            memcpy(dir->mData.get(), pData, dir->mNode.mDataSize);
-            delete [] pData;
+            u64 dataOffs = (u64)mHeader.mFileDataOffset + mHeader.mHeaderSize + dir->mNode.mData;
+
+            if (image && dataOffs + dir->mNode.mDataSize <= imageSize)
+                dir->mData = std::shared_ptr<u8[]>(image, image.get() + dataOffs);
+            else {
+                u32 curPos = reader.position();
+                reader.seek(dataOffs, std::ios::beg);
+                dir->mData = std::shared_ptr<u8[]>(reader.readBytes(dir->mNode.mDataSize, EndianSelect::Little));
+                reader.seek(curPos, std::ios::beg);
+            }
         }
 
         mDirectories.push_back(dir);
@@ -211,9 +370,9 @@ void JKRArchive::write(BinaryWriter &writer, bool reduceStrings) {
     u32 aramSize;
     u32 dvdSize;
 
-    writeFileData(writer, mMRAMFiles, &mramSize);
-    writeFileData(writer, mARAMFiles, &aramSize);
-    writeFileData(writer, mDVDFiles, &dvdSize);
+    writeFileData(writer, mMRAMFiles, fileDataOffs + 0x20, &mramSize);
+    writeFileData(writer, mARAMFiles, fileDataOffs + 0x20, &aramSize);
+    writeFileData(writer, mDVDFiles, fileDataOffs + 0x20, &dvdSize);
 
     u32 fileDataSize = mramSize + aramSize + dvdSize;
 
@@ -250,16 +409,64 @@ void JKRArchive::write(BinaryWriter &writer, bool reduceStrings) {
     writer.write<u8>(mSyncFileIds);
 }
 
-void JKRArchive::writeFileData(BinaryWriter &writer, std::vector<std::shared_ptr<JKRDirectory>> files, u32 *pSize) {
+void JKRArchive::writeFileData(BinaryWriter &writer, std::vector<std::shared_ptr<JKRDirectory>> files, u32 fileDataStart, u32 *pSize) {
     u32 startPos = writer.size();
 
     for (auto dir : files) {
-        if (dir->mAttr & JKRFileAttr_USE_SZS) {
-            auto ptr = JKRCompression::encodeSZSFast(dir->mData.get(), dir->mNode.mDataSize, &dir->mNode.mDataSize);
-            dir->mData = std::shared_ptr<u8[]>(new u8[dir->mNode.mDataSize]);
-            memcpy(dir->mData.get(), ptr, dir->mNode.mDataSize);
+        JKRCompressionType compType = dir->getCompressionType();
+
+        JKRCompressionType dataType = JKRCompression::checkCompression(dir->mData.get(), dir->mNode.mDataSize, false);
+
+        // Entries decompressed with the payload kept are written back exactly as they were read
+        if (compType != JKRCompressionType_NONE && dir->mCompressedData) {
+            dir->mData = dir->mCompressedData;
+            dir->mNode.mDataSize = dir->mCompressedSize;
+            dir->mCompressedData = nullptr;
+        }
+        // Data that already is Yaz0 or Yay0, e.g. a nested szs or an entry of a loaded archive, isn't compressed
+        // twice. It's written as it is and the attributes are made to describe the format it's really in.
+        else if (compType != JKRCompressionType_NONE && (dataType == JKRCompressionType_SZS || dataType == JKRCompressionType_SZP)) {
+            if (dataType == JKRCompressionType_SZS)
+                dir->mAttr = (JKRFileAttr)(dir->mAttr | JKRFileAttr_USE_SZS);
+            else
+                dir->mAttr = (JKRFileAttr)(dir->mAttr & ~JKRFileAttr_USE_SZS);
+        }
+        else if (compType != JKRCompressionType_NONE && !JKRCompression::isWorthCompressing(dir->mData.get(), dir->mNode.mDataSize, mCompressionContext.get())) {
+            printf("%s doesn't compress, storing it uncompressed\n", dir->mName.c_str());
+            dir->mAttr = (JKRFileAttr)(dir->mAttr & ~(JKRFileAttr_COMPRESSED | JKRFileAttr_USE_SZS));
+        }
+        else if (compType != JKRCompressionType_NONE) {
+            std::string encoder = JKRCompression::getCacheEncoderName(compType, mCompressionLevel, mCompressionContext.get());
+            u32 compressedSize;
+            const u8* ptr = nullptr;
+
+            if (mCompressionCache)
+                ptr = mCompressionCache->load(dir->mData.get(), dir->mNode.mDataSize, encoder, mCompressionLevel, &compressedSize);
+
+            if (!ptr) {
+                // Entries are small, one thread each keeps the output independent of the machine
+                if (compType == JKRCompressionType_SZS)
+                    ptr = JKRCompression::encodeSZS(dir->mData.get(), dir->mNode.mDataSize, &compressedSize, mCompressionLevel, false, mCompressionContext.get());
+                else
+                    ptr = JKRCompression::encodeSZP(dir->mData.get(), dir->mNode.mDataSize, &compressedSize, mCompressionLevel, 1, cSZSSegmentSize, mCompressionContext.get());
+
+                if (mCompressionCache)
+                    mCompressionCache->store(dir->mData.get(), dir->mNode.mDataSize, encoder, mCompressionLevel, ptr, compressedSize);
+            }
+
+            // Anything that doesn't end up smaller is stored raw, the game then also skips decompressing it
+            if (compressedSize >= dir->mNode.mDataSize) {
+                printf("%s doesn't compress, storing it uncompressed\n", dir->mName.c_str());
+                dir->mAttr = (JKRFileAttr)(dir->mAttr & ~(JKRFileAttr_COMPRESSED | JKRFileAttr_USE_SZS));
+            }
+            else {
+                dir->mNode.mDataSize = compressedSize;
+                dir->mData = std::shared_ptr<u8[]>(new u8[dir->mNode.mDataSize]);
+                memcpy(dir->mData.get(), ptr, dir->mNode.mDataSize);
+            }
             delete [] ptr;
         }
+        dir->mNode.mData = writer.size() - fileDataStart;
         writer.writeBytes(dir->mData.get(), dir->mNode.mDataSize);
         writer.align32();
     }
@@ -360,22 +567,90 @@ void JKRArchive::collectStrings(std::shared_ptr<JKRFolderNode>pNode, StringPool*
 }
 
 void JKRFolderNode::unpack(const std::string &filePath) {
-    std::string fullpath;
-    for (s32 i = 0; i < mChildDirs.size(); i++) {
-        
-        if (mChildDirs[i]->mName == "." || mChildDirs[i]->mName == "..")
-            continue;
+    std::string fullpath = filePath + "/";
+    JKRArchiveWalker walker(this);
 
-        fullpath = filePath + "/" + mChildDirs[i]->mName;
+    while (walker.next()) {
+        const std::shared_ptr<JKRDirectory> &dir = walker.getEntry();
+        fullpath.resize(filePath.size() + 1);
+        fullpath += walker.getPath();
 
-        if (mChildDirs[i]->isDirectory()) {      
+        if (dir->isDirectory())
             ghc::filesystem::create_directories(fullpath);
-            mChildDirs[i]->mFolderNode->unpack(fullpath);
+        else if (dir->isFile()) {
+            File::writeAllBytes(fullpath, dir->mData.get(), dir->mNode.mDataSize);
+
+            // Kept by decompressEntries, the original payload goes next to the decompressed file
+            if (dir->mCompressedData) {
+                bool isSZS = JKRCompression::checkCompression(dir->mCompressedData.get(), dir->mCompressedSize, false) == JKRCompressionType_SZS;
+                File::writeAllBytes(fullpath + (isSZS ? ".szs" : ".szp"), dir->mCompressedData.get(), dir->mCompressedSize);
+            }
         }
-        else if (mChildDirs[i]->isFile()) {
-            File::writeAllBytes(fullpath, mChildDirs[i]->mData.get(), mChildDirs[i]->mNode.mDataSize);
+    }
+}
+
+JKRArchiveWalker::JKRArchiveWalker(const JKRFolderNode *pFolder, JKRWalkOrder order) {
+    mOrder = order;
+    enterFolder(pFolder, 0);
+}
+
+// Depth first the folder's path is the prefix of mPath when it's entered, breadth first it's queued
+// behind the others so its path is copied to mFolderPaths, once per folder rather than per entry
+void JKRArchiveWalker::enterFolder(const JKRFolderNode *pFolder, u32 depth) {
+    Frame frame;
+    frame.mFolder = pFolder;
+    frame.mNextChild = 0;
+    frame.mDepth = depth;
+    frame.mPathOffs = 0;
+    frame.mPathLength = mPath.size();
+
+    if (mOrder == JKRWalkOrder_BREADTH_FIRST) {
+        frame.mPathOffs = mFolderPaths.size();
+        mFolderPaths += mPath;
+    }
+
+    mFrames.push_back(frame);
+}
+
+bool JKRArchiveWalker::next() {
+    // The folder returned last is entered now so skipFolder can still leave it out
+    if (mEntry && (*mEntry)->isDirectory() && (*mEntry)->mFolderNode && !mSkipFolder)
+        enterFolder((*mEntry)->mFolderNode.get(), mDepth + 1);
+
+    mEntry = nullptr;
+    mSkipFolder = false;
+
+    while (mNextFrame < mFrames.size()) {
+        bool depthFirst = mOrder == JKRWalkOrder_DEPTH_FIRST;
+        Frame &frame = depthFirst ? mFrames.back() : mFrames[mNextFrame];
+
+        if (frame.mNextChild >= frame.mFolder->mChildDirs.size()) {
+            if (depthFirst)
+                mFrames.pop_back();
+            else
+                mNextFrame++;
+            continue;
         }
+
+        const std::shared_ptr<JKRDirectory> &dir = frame.mFolder->mChildDirs[frame.mNextChild++];
+        if (dir->isShortcut())
+            continue;
+
+        if (depthFirst)
+            mPath.resize(frame.mPathLength);
+        else
+            mPath.assign(mFolderPaths, frame.mPathOffs, frame.mPathLength);
+
+        if (!mPath.empty())
+            mPath += '/';
+        mPath += dir->mName;
+
+        mEntry = &dir;
+        mDepth = frame.mDepth;
+        return true;
     }
+
+    return false;
 }
 
 std::string JKRFolderNode::getShortName() {
@@ -412,6 +687,12 @@ JKRDirectory::JKRDirectory() {
     mParentNode = nullptr;
     mName = "";
     mData = nullptr;
+    mNode.mDataSize = 0;
+    mNode.mData = 0;
+    mNode.mAttrAndNameOffs = 0;
+    mNode.mHash = 0;
+    mNode.mNodeIdx = 0xFFFF;
+    mNameOffs = 0;
 }
 
 JKRCompressionType JKRDirectory::getCompressionType() {
@@ -437,4 +718,229 @@ JKRPreloadType JKRDirectory::getPreloadType() {
     }
 
     return JKRPreloadType_NONE;
-}
\ No newline at end of file
+}
+namespace JKRArchivePatch {
+    struct FileEntry {
+        u32 mAttrAndNameOffs;
+        u32 mData;
+        u32 mDataSize;
+    };
+
+    // Walks rPath from startIdx on down from the root folder, *pEntryIdx is only set when the file was found
+    static bool findEntry(BinaryReader &reader, const std::vector<JKRFolderNode::Node> &rFolders, const std::vector<FileEntry> &rEntries, u32 stringTableStart, const std::vector<std::string> &rPath, u32 startIdx, u32 *pEntryIdx) {
+        u32 folder = 0;
+
+        for (u32 i = startIdx; i < rPath.size(); i++) {
+            const JKRFolderNode::Node &node = rFolders[folder];
+            bool isLast = i == rPath.size() - 1;
+            bool found = false;
+            u32 foundIdx = 0;
+
+            for (u32 y = node.mFirstFileOffs; y < node.mFirstFileOffs + node.mFileCount && y < rEntries.size(); y++) {
+                u32 attr = rEntries[y].mAttrAndNameOffs >> 24;
+                std::string name = reader.readNullTerminatedStringAt(stringTableStart + (rEntries[y].mAttrAndNameOffs & 0x00FFFFFF));
+
+                if (name == "." || name == ".." || strcasecmp(name.c_str(), rPath[i].c_str()))
+                    continue;
+
+                if (isLast ? (attr & JKRFileAttr_FILE) : ((attr & JKRFileAttr_FOLDER) && rEntries[y].mData < rFolders.size())) {
+                    found = true;
+                    foundIdx = y;
+                    break;
+                }
+            }
+
+            if (!found)
+                return false;
+            if (isLast) {
+                *pEntryIdx = foundIdx;
+                return true;
+            }
+
+            folder = rEntries[foundIdx].mData;
+        }
+
+        return false;
+    }
+
+    bool replaceFile(const std::string &archivePath, const std::string &entryPath, const u8 *pData, u32 size) {
+        EndianSelect endian = EndianSelect::Big;
+        u32 fileSize, headerSize, fileDataStart, fileDataSize;
+        u32 sectionSizes[3];
+        u32 fileNodeStart;
+        std::vector<FileEntry> entries;
+        u32 entryIdx = 0;
+        bool found = false;
+        u32 tailSize = 0;
+        u8* pTail = nullptr;
+
+        {
+            BinaryReader reader(archivePath, EndianSelect::Big);
+            std::string magic = reader.readString(0x4);
+
+            if (magic == "CRAR")
+                reader.mEndian = endian = EndianSelect::Little;
+            else if (magic != "RARC") {
+                printf("Fatal error! %s is not an uncompressed JKRArchive\n", archivePath.c_str());
+                return false;
+            }
+
+            fileSize = reader.read<u32>();
+            headerSize = reader.read<u32>();
+            fileDataStart = reader.read<u32>() + headerSize;
+            fileDataSize = reader.read<u32>();
+            for (s32 i = 0; i < 3; i++)
+                sectionSizes[i] = reader.read<u32>();
+
+            u32 dirNodeCount = reader.read<u32>();
+            u32 dirNodeStart = reader.read<u32>() + headerSize;
+            u32 fileNodeCount = reader.read<u32>();
+            fileNodeStart = reader.read<u32>() + headerSize;
+            reader.skip(4);
+            u32 stringTableStart = reader.read<u32>() + headerSize;
+
+            std::vector<JKRFolderNode::Node> folders(dirNodeCount);
+            reader.seek(dirNodeStart, std::ios::beg);
+            for (auto &node : folders) {
+                reader.skip(4);
+                node.mNameOffs = reader.read<u32>();
+                node.mHash = reader.read<u16>();
+                node.mFileCount = reader.read<u16>();
+                node.mFirstFileOffs = reader.read<u32>();
+            }
+
+            entries.resize(fileNodeCount);
+            reader.seek(fileNodeStart, std::ios::beg);
+            for (auto &entry : entries) {
+                reader.skip(4);
+                entry.mAttrAndNameOffs = reader.read<u32>();
+                entry.mData = reader.read<u32>();
+                entry.mDataSize = reader.read<u32>();
+                reader.skip(4);
+            }
+
+            std::vector<std::string> path;
+            std::string part;
+            for (char c : entryPath + "/") {
+                if (c == '/' || c == '\\') {
+                    if (!part.empty())
+                        path.push_back(part);
+                    part.clear();
+                }
+                else
+                    part.push_back(c);
+            }
+
+            if (!path.empty() && !folders.empty()) {
+                found = findEntry(reader, folders, entries, stringTableStart, path, 0, &entryIdx);
+
+                // Also accept paths that start with the root folder name, as produced by unpack
+                std::string rootName = reader.readNullTerminatedStringAt(stringTableStart + folders[0].mNameOffs);
+                if (!found && path.size() > 1 && !strcasecmp(path[0].c_str(), rootName.c_str()))
+                    found = findEntry(reader, folders, entries, stringTableStart, path, 1, &entryIdx);
+            }
+
+            if (!found) {
+                printf("Fatal error! %s was not found in the archive\n", entryPath.c_str());
+                return false;
+            }
+        }
+
+        FileEntry &entry = entries[entryIdx];
+        u32 oldSlot = Util::align32(entry.mDataSize);
+        u32 newSlot = Util::align32(size);
+        u32 insertAt = 0;
+        u32 shift = 0;
+
+        if (newSlot > oldSlot) {
+            // Grow the entry's preload section so MRAM/ARAM/DVD ranges stay valid.
+            // Anything stored after the section moves back by the growth.
+            u32 sectionEnd = 0;
+            s32 section;
+            for (section = 0; section < 3; section++) {
+                sectionEnd += sectionSizes[section];
+                if (entry.mData < sectionEnd)
+                    break;
+            }
+            if (section == 3)
+                section = 2;
+
+            if (entry.mData + oldSlot == sectionEnd) {
+                insertAt = sectionEnd;
+                shift = newSlot - oldSlot;
+            }
+            else {
+                insertAt = sectionEnd;
+                shift = newSlot;
+            }
+
+            for (u32 i = 0; i < entries.size(); i++) {
+                if (i != entryIdx && (entries[i].mAttrAndNameOffs >> 24) & JKRFileAttr_FILE && entries[i].mData >= insertAt)
+                    entries[i].mData += shift;
+            }
+
+            if (shift == newSlot)
+                entry.mData = insertAt;
+
+            sectionSizes[section] += shift;
+            fileDataSize += shift;
+
+            BinaryReader reader(archivePath, endian);
+            u32 physicalSize = reader.size();
+            if (physicalSize > fileDataStart + insertAt) {
+                tailSize = physicalSize - (fileDataStart + insertAt);
+                reader.seek(fileDataStart + insertAt, std::ios::beg);
+                pTail = reader.readBytes(tailSize, EndianSelect::Little);
+            }
+            fileSize = std::max(fileSize, physicalSize) + shift;
+        }
+
+        u32 attr = entry.mAttrAndNameOffs >> 24;
+        if (attr & JKRFileAttr_COMPRESSED) {
+            bool isYaz0 = size >= 4 && !memcmp(pData, "Yaz0", 4);
+            bool isYay0 = size >= 4 && !memcmp(pData, "Yay0", 4);
+
+            if ((attr & JKRFileAttr_USE_SZS) ? !isYaz0 : !isYay0) {
+                printf("Replacement data isn't compressed, clearing the compression flags of %s\n", entryPath.c_str());
+                attr &= ~(JKRFileAttr_COMPRESSED | JKRFileAttr_USE_SZS);
+            }
+        }
+        entry.mAttrAndNameOffs = (attr << 24) | (entry.mAttrAndNameOffs & 0x00FFFFFF);
+        entry.mDataSize = size;
+
+        BinaryWriter writer(new std::fstream(archivePath, std::ios::in | std::ios::out | std::ios::binary));
+        writer.mEndian = endian;
+
+        if (pTail) {
+            writer.seek(fileDataStart + insertAt + shift, std::ios::beg);
+            writer.writeBytes(pTail, tailSize);
+            delete [] pTail;
+        }
+
+        writer.seek(fileDataStart + entry.mData, std::ios::beg);
+        writer.writeBytes(pData, size);
+        writer.writePadding(0x0, newSlot - size);
+        if (newSlot < oldSlot && shift == 0)
+            writer.writePadding(0x0, oldSlot - newSlot);
+
+        for (u32 i = 0; i < entries.size(); i++) {
+            if (i != entryIdx && shift == 0)
+                continue;
+            writer.seek(fileNodeStart + i * 0x14 + 0x4, std::ios::beg);
+            writer.write<u32>(entries[i].mAttrAndNameOffs);
+            writer.write<u32>(entries[i].mData);
+            writer.write<u32>(entries[i].mDataSize);
+        }
+
+        if (shift) {
+            writer.seek(0x4, std::ios::beg);
+            writer.write<u32>(fileSize);
+            writer.seek(0x10, std::ios::beg);
+            writer.write<u32>(fileDataSize);
+            for (s32 i = 0; i < 3; i++)
+                writer.write<u32>(sectionSizes[i]);
+        }
+
+        return true;
+    }
+};
@@ -0,0 +1,211 @@
+#include "..\Include\JKRArchiveView.h"
+#include <string.h>
+#include <algorithm>
+
+namespace {
+    const u32 cViewFolderNodeSize = 0x10;
+    const u32 cViewFileNodeSize = 0x14;
+
+    bool viewNamesEqual(std::string_view a, std::string_view b) {
+        if (a.size() != b.size())
+            return false;
+
+        for (u32 i = 0; i < a.size(); i++) {
+            if (tolower((u8)a[i]) != tolower((u8)b[i]))
+                return false;
+        }
+        return true;
+    }
+
+    // Splits off the first component of a path, either slash separates them
+    std::string_view viewNextPart(std::string_view &rPath) {
+        while (!rPath.empty() && (rPath[0] == '/' || rPath[0] == '\\'))
+            rPath.remove_prefix(1);
+
+        u32 end = 0;
+        while (end < rPath.size() && rPath[end] != '/' && rPath[end] != '\\')
+            end++;
+
+        std::string_view part = rPath.substr(0, end);
+        rPath.remove_prefix(end);
+        return part;
+    }
+};
+
+// Only the fixed headers are read here, so opening costs the same for any archive
+bool JKRArchiveView::open(const u8 *pData, u32 size) {
+    mData = nullptr;
+
+    if (size < 0x40 || (memcmp(pData, "RARC", 4) && memcmp(pData, "CRAR", 4)))
+        return false;
+
+    mLittleEndian = !memcmp(pData, "CRAR", 4);
+
+    u64 headerSize = readU32(pData + 0x8);
+    u64 fileDataStart = headerSize + readU32(pData + 0xC);
+    u64 fileDataSize = readU32(pData + 0x10);
+    u64 folderCount = readU32(pData + 0x20);
+    u64 folderStart = headerSize + readU32(pData + 0x24);
+    u64 entryCount = readU32(pData + 0x28);
+    u64 entryStart = headerSize + readU32(pData + 0x2C);
+    u64 stringTableSize = readU32(pData + 0x30);
+    u64 stringTableStart = headerSize + readU32(pData + 0x34);
+
+    if (folderCount == 0 || folderStart + folderCount * cViewFolderNodeSize > size || entryStart + entryCount * cViewFileNodeSize > size ||
+        stringTableStart + stringTableSize > size || fileDataStart + fileDataSize > size)
+        return false;
+
+    mFolders = pData + folderStart;
+    mFolderCount = folderCount;
+    mEntries = pData + entryStart;
+    mEntryCount = entryCount;
+    mStrings = pData + stringTableStart;
+    mStringTableSize = stringTableSize;
+    mFileData = pData + fileDataStart;
+    mFileDataSize = fileDataSize;
+    mData = pData;
+    return true;
+}
+
+u32 JKRArchiveView::readU32(const u8 *pData) const {
+    if (mLittleEndian)
+        return pData[0] | (pData[1] << 8) | (pData[2] << 16) | (pData[3] << 24);
+    return (pData[0] << 24) | (pData[1] << 16) | (pData[2] << 8) | pData[3];
+}
+
+u16 JKRArchiveView::readU16(const u8 *pData) const {
+    if (mLittleEndian)
+        return pData[0] | (pData[1] << 8);
+    return (pData[0] << 8) | pData[1];
+}
+
+// Names run up to their terminator, one that's missing ends the name at the table's end
+std::string_view JKRArchiveView::readName(u32 offs) const {
+    if (offs >= mStringTableSize)
+        return std::string_view();
+
+    const char* pName = (const char*)mStrings + offs;
+    const void* pEnd = memchr(pName, 0, mStringTableSize - offs);
+    return std::string_view(pName, pEnd ? (const char*)pEnd - pName : mStringTableSize - offs);
+}
+
+JKRArchiveView::Folder JKRArchiveView::getFolder(u32 idx) const {
+    Folder folder;
+    if (isOpen() && idx < mFolderCount) {
+        folder.mView = this;
+        folder.mNode = mFolders + idx * cViewFolderNodeSize;
+    }
+    return folder;
+}
+
+JKRArchiveView::Entry JKRArchiveView::getEntry(u32 idx) const {
+    Entry entry;
+    if (isOpen() && idx < mEntryCount) {
+        entry.mView = this;
+        entry.mNode = mEntries + idx * cViewFileNodeSize;
+    }
+    return entry;
+}
+
+JKRArchiveView::Entry JKRArchiveView::findFrom(Folder folder, std::string_view path) const {
+    std::string_view part = viewNextPart(path);
+
+    while (folder.isValid() && !part.empty()) {
+        Entry entry = folder.find(part);
+        part = viewNextPart(path);
+
+        // The last part may name anything, the ones before it have to be folders
+        if (part.empty())
+            return entry;
+        folder = entry.isValid() && entry.isFolder() ? entry.getFolder() : Folder();
+    }
+
+    return Entry();
+}
+
+JKRArchiveView::Entry JKRArchiveView::find(std::string_view path) const {
+    Folder root = getRoot();
+    Entry entry = findFrom(root, path);
+
+    // Also accept paths that start with the root folder name, as produced by unpack
+    std::string_view rest = path;
+    if (!entry.isValid() && viewNamesEqual(viewNextPart(rest), root.getName()))
+        entry = findFrom(root, rest);
+    return entry;
+}
+
+// Invalid handles read as empty, so lookups can be chained without checking every step
+
+std::string_view JKRArchiveView::Entry::getName() const {
+    if (!mNode)
+        return std::string_view();
+    return mView->readName(mView->readU32(mNode + 0x4) & 0x00FFFFFF);
+}
+
+u16 JKRArchiveView::Entry::getId() const {
+    if (!mNode)
+        return 0xFFFF;
+    return mView->readU16(mNode);
+}
+
+JKRFileAttr JKRArchiveView::Entry::getAttr() const {
+    if (!mNode)
+        return (JKRFileAttr)0;
+    return (JKRFileAttr)(mView->readU32(mNode + 0x4) >> 24);
+}
+
+bool JKRArchiveView::Entry::isShortcut() const {
+    std::string_view name = getName();
+    return isFolder() && (name == "." || name == "..");
+}
+
+JKRArchiveSpan JKRArchiveView::Entry::getData() const {
+    JKRArchiveSpan span;
+    if (!isFile())
+        return span;
+
+    u64 offs = mView->readU32(mNode + 0x8);
+    u64 size = mView->readU32(mNode + 0xC);
+    if (offs + size <= mView->mFileDataSize) {
+        span.mData = mView->mFileData + offs;
+        span.mSize = size;
+    }
+    return span;
+}
+
+JKRArchiveView::Folder JKRArchiveView::Entry::getFolder() const {
+    if (!isFolder())
+        return Folder();
+    return mView->getFolder(mView->readU32(mNode + 0x8));
+}
+
+std::string_view JKRArchiveView::Folder::getName() const {
+    if (!mNode)
+        return std::string_view();
+    return mView->readName(mView->readU32(mNode + 0x4));
+}
+
+// Folders whose entry range runs past the table are cut short
+u32 JKRArchiveView::Folder::getEntryCount() const {
+    if (!mNode)
+        return 0;
+
+    u32 first = mView->readU32(mNode + 0xC);
+    u32 count = mView->readU16(mNode + 0xA);
+    return first < mView->mEntryCount ? std::min(count, mView->mEntryCount - first) : 0;
+}
+
+JKRArchiveView::Entry JKRArchiveView::Folder::getEntry(u32 idx) const {
+    if (idx >= getEntryCount())
+        return Entry();
+    return mView->getEntry(mView->readU32(mNode + 0xC) + idx);
+}
+
+JKRArchiveView::Entry JKRArchiveView::Folder::find(std::string_view name) const {
+    for (u32 i = 0; i < getEntryCount(); i++) {
+        Entry entry = getEntry(i);
+        if (!entry.isShortcut() && viewNamesEqual(entry.getName(), name))
+            return entry;
+    }
+    return Entry();
+}
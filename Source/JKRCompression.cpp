@@ -1,37 +1,772 @@
 #include "..\Include\JKRCompression.h"
 #include "..\Include\Util.h"
+#include "..\Include\JKRMatchFinder.h"
+#include "..\Include\JKRCompressionContext.h"
+#include "..\Include\JKRSZSStream.h"
+#include "..\Include\JKRSZSIndex.h"
 #include <iostream>
+#include <thread>
+#include <atomic>
+#include <memory>
+
+namespace {
+    // Read size of the file decoders
+    const u32 cSZSFileChunkSize = 0x10000;
+
+    // Collects Yay0's three streams: 32-bit mask words, 16-bit links, and the chunk bytes that hold
+    // both literals and the extra length byte of long matches
+    class SZPStreamWriter {
+    public:
+        void writeLiteral(u8 val) {
+            writeMaskBit(true);
+            mChunks.push_back(val);
+        }
+
+        void writeMatch(u32 back, u32 length) {
+            writeMaskBit(false);
+            u32 dist = back - 1;
+
+            if (length >= 0x12) {
+                mLinks.push_back(dist >> 8);
+                mLinks.push_back(dist & 0xFF);
+                mChunks.push_back(length - 0x12);
+            }
+            else {
+                mLinks.push_back(((length - 2) << 4) | (dist >> 8));
+                mLinks.push_back(dist & 0xFF);
+            }
+        }
+
+        // Links and chunks concatenate as they are, mask words only when this writer is on a word boundary
+        void append(const SZPStreamWriter &other) {
+            if (mBitCount == 0) {
+                mMasks.insert(mMasks.end(), other.mMasks.begin(), other.mMasks.end());
+                mBitCount = other.mBitCount;
+            }
+            else {
+                u32 bitCount = other.mMasks.size() * 32 - (other.mBitCount ? 32 - other.mBitCount : 0);
+                for (u32 i = 0; i < bitCount; i++)
+                    writeMaskBit(other.mMasks[i / 32] & (0x80000000 >> (i % 32)));
+            }
+
+            mLinks.insert(mLinks.end(), other.mLinks.begin(), other.mLinks.end());
+            mChunks.insert(mChunks.end(), other.mChunks.begin(), other.mChunks.end());
+        }
+
+        u8* finish(u32 srcSize, u32 *pDstSize) {
+            u32 linkOffs = 0x10 + mMasks.size() * 4;
+            u32 chunkOffs = linkOffs + mLinks.size();
+            u32 dstSize = chunkOffs + mChunks.size();
+            u8* dst = new u8[dstSize];
+
+            memcpy(dst, "Yay0", 4);
+            u32 header[] = { srcSize, linkOffs, chunkOffs };
+            for (u32 i = 0; i < 3; i++)
+                writeU32(dst + 4 + i * 4, header[i]);
+            for (u32 i = 0; i < mMasks.size(); i++)
+                writeU32(dst + 0x10 + i * 4, mMasks[i]);
+            std::copy(mLinks.begin(), mLinks.end(), dst + linkOffs);
+            std::copy(mChunks.begin(), mChunks.end(), dst + chunkOffs);
+
+            *pDstSize = dstSize;
+            return dst;
+        }
+    private:
+        void writeMaskBit(bool literal) {
+            if (mBitCount == 0)
+                mMasks.push_back(0);
+            if (literal)
+                mMasks.back() |= 0x80000000 >> mBitCount;
+            mBitCount = (mBitCount + 1) & 31;
+        }
+
+        static void writeU32(u8 *pDst, u32 val) {
+            pDst[0] = (val >> 24) & 0xFF;
+            pDst[1] = (val >> 16) & 0xFF;
+            pDst[2] = (val >> 8) & 0xFF;
+            pDst[3] = val & 0xFF;
+        }
+
+        std::vector<u32> mMasks;
+        std::vector<u8> mLinks;
+        std::vector<u8> mChunks;
+        u32 mBitCount = 0;
+    };
+
+    // Allocates room for the worst case, all literals with one flag byte per 8 of them, and writes the header
+    u8* allocSZS(u32 srcSize) {
+        u8* dst = new u8[0x10 + srcSize + srcSize / 8 + 1];
+        memcpy(dst, "Yaz0", 4);
+        dst[4] = (srcSize >> 24) & 0xFF;
+        dst[5] = (srcSize >> 16) & 0xFF;
+        dst[6] = (srcSize >> 8) & 0xFF;
+        dst[7] = srcSize & 0xFF;
+        memset(dst + 8, 0, 8);
+        return dst;
+    }
+
+    // Match search settings of the hash-chain levels, see JKRCompressionLevel
+    struct SZSLevelParams {
+        u32 mChainDepth;
+        bool mLazy;
+    };
+
+    const SZSLevelParams cSZSLevelParams[] = {
+        { 0, false },
+        { 1, false },
+        { 4, false },
+        { 16, false },
+        { 32, true },
+        { 64, true },
+        { 128, true },
+        { 256, true },
+        { cSZSWindowSize, true },
+    };
+
+    u8* encodeSZSStore(const u8 *src, u32 srcSize, u32 *pDstSize) {
+        u8* dst = allocSZS(srcSize);
+        u32 pos = 0x10;
+
+        for (u32 i = 0; i < srcSize; i += 8) {
+            u32 count = std::min<u32>(8, srcSize - i);
+            dst[pos++] = (u8)(0xFF00 >> count);
+            memcpy(dst + pos, src + i, count);
+            pos += count;
+        }
+
+        *pDstSize = pos;
+        return dst;
+    }
+
+    // Matches stay inside [start, end), the window before start is only used as history
+    template<typename Finder>
+    void primeFinder(Finder &finder, const u8 *src, u32 start, u32 end) {
+        finder.reset(src, end);
+        for (u32 pos = start > cSZSWindowSize ? start - cSZSWindowSize : 0; pos < start; pos++)
+            finder.insert(pos);
+    }
+
+    // Token costs in bits, flag bit included
+    const u32 cSZSLiteralCost = 9;
+    const u32 cSZSShortMatchCost = 17;
+    const u32 cSZSLongMatchCost = 25;
+
+    // Size of a match token plus the decode penalty of the context, see JKRCompressionContext::mMatchPenalty
+    u32 getMatchCost(const JKRCompressionContext &context, u32 length) {
+        return (length >= 0x12 ? cSZSLongMatchCost : cSZSShortMatchCost) + context.mMatchPenalty;
+    }
+
+    // How often the hash chain parser looks at the clock, in input bytes
+    const u32 cSZSDeadlineInterval = 0x10000;
+
+    // The parsers below only emit tokens, so they drive both the Yaz0 and the Yay0 writer
+    template<typename Writer>
+    void encodeSZSHashChain(JKRCompressionContext &context, const u8 *src, u32 start, u32 end, u32 chainDepth, bool lazy, Writer &writer, bool showProgress) {
+        JKRMatchFinder &finder = context.mFinder;
+        finder.mChainDepth = chainDepth;
+        primeFinder(finder, src, start, end);
+
+        u32 pos = start;
+        u32 length = 0;
+        u32 matchPos = 0;
+        bool haveMatch = false;
+        u32 percent = 0;
+        u32 nextDeadlineCheck = start + cSZSDeadlineInterval;
+
+        while (pos < end) {
+            if (pos >= nextDeadlineCheck) {
+                if (context.isPastDeadline()) {
+                    context.mAbandoned = true;
+                    return;
+                }
+                nextDeadlineCheck = pos + cSZSDeadlineInterval;
+            }
+
+            if (!haveMatch)
+                length = finder.findMatch(pos, &matchPos);
+            haveMatch = false;
+            finder.insert(pos);
+
+            // Lazy matching, a literal now is worth it if the next position has a longer match
+            if (lazy && length && length < finder.mNiceLength && pos + 1 < end) {
+                u32 nextMatchPos;
+                u32 nextLength = finder.findMatch(pos + 1, &nextMatchPos);
+
+                if (nextLength > length) {
+                    writer.writeLiteral(src[pos++]);
+                    length = nextLength;
+                    matchPos = nextMatchPos;
+                    haveMatch = true;
+                    continue;
+                }
+            }
+
+            // Literals are cheaper to decode, a match has to save more than its penalty
+            if (length && getMatchCost(context, length) >= length * cSZSLiteralCost)
+                length = 0;
+
+            if (length) {
+                writer.writeMatch(pos - matchPos, length);
+                for (u32 i = 1; i < length; i++)
+                    finder.insert(pos + i);
+                pos += length;
+            }
+            else
+                writer.writeLiteral(src[pos++]);
+
+            if (showProgress && (u64)(pos - start) * 100 / (end - start) != percent) {
+                percent = (u64)(pos - start) * 100 / (end - start);
+                printf("\rProgress: %u%%", (unsigned)percent);
+            }
+        }
+    }
+
+    // The parse is solved per block to bound memory. Each block looks a little past its end
+    // so tokens may cross it, the next block starts wherever the last emitted token ended.
+    const u32 cSZSOptimalBlockSize = 0x40000;
+    const u32 cSZSOptimalLookahead = 0x1000;
+
+    // Yay0 tokens cost exactly the same number of bits, so the parse is optimal for both formats
+    template<typename Finder, typename Writer>
+    void encodeSZSOptimalParse(JKRCompressionContext &context, Finder &finder, const u8 *src, u32 start, u32 end, Writer &writer, bool showProgress) {
+        primeFinder(finder, src, start, end);
+
+        u32 capacity = std::min(end - start, cSZSOptimalBlockSize + cSZSOptimalLookahead);
+        std::vector<u16> &lengths = context.mLengths;
+        std::vector<u16> &backs = context.mBacks;
+        std::vector<u16> &choices = context.mChoices;
+        std::vector<u32> &costs = context.mCosts;
+
+        if (lengths.size() < capacity) {
+            lengths.resize(capacity);
+            backs.resize(capacity);
+            choices.resize(capacity);
+            costs.resize(capacity + 1);
+        }
+
+        // Match info is valid for [base, base + computed)
+        u32 base = start;
+        u32 computed = 0;
+
+        while (base < end) {
+            if (context.isPastDeadline()) {
+                context.mAbandoned = true;
+                return;
+            }
+
+            u32 regionSize = std::min(end - base, cSZSOptimalBlockSize + cSZSOptimalLookahead);
+            bool isLast = base + regionSize == end;
+
+            // The longest match is all that matters per position, every shorter length reuses its distance
+            for (u32 i = computed; i < regionSize; i++) {
+                u32 matchPos;
+                u32 length = finder.findMatch(base + i, &matchPos);
+                finder.insert(base + i);
+
+                lengths[i] = length;
+                backs[i] = length ? base + i - matchPos : 0;
+            }
+            computed = regionSize;
+
+            // Cheapest cost from every position to the region end, ties go to the longer token
+            costs[regionSize] = 0;
+            for (s32 i = regionSize - 1; i >= 0; i--) {
+                u32 best = 0xFFFFFFFF;
+                u32 choice = 1;
+
+                for (u32 length = std::min<u32>(lengths[i], regionSize - i); length >= cSZSMinMatch; length--) {
+                    u32 cost = getMatchCost(context, length) + costs[i + length];
+                    if (cost < best) {
+                        best = cost;
+                        choice = length;
+                    }
+                }
+
+                if (cSZSLiteralCost + costs[i + 1] < best) {
+                    best = cSZSLiteralCost + costs[i + 1];
+                    choice = 1;
+                }
+
+                costs[i] = best;
+                choices[i] = choice;
+            }
+
+            u32 emitEnd = isLast ? regionSize : std::min(regionSize, cSZSOptimalBlockSize);
+            u32 i = 0;
+            for (; i < emitEnd; i += choices[i]) {
+                if (choices[i] == 1)
+                    writer.writeLiteral(src[base + i]);
+                else
+                    writer.writeMatch(backs[i], choices[i]);
+            }
+
+            std::copy(lengths.begin() + i, lengths.begin() + computed, lengths.begin());
+            std::copy(backs.begin() + i, backs.begin() + computed, backs.begin());
+            computed -= i;
+            base += i;
+
+            if (showProgress)
+                printf("\rProgress: %u%%", (unsigned)((u64)(base - start) * 100 / (end - start)));
+        }
+    }
+
+    template<typename Writer>
+    void encodeSZSRange(JKRCompressionContext &context, const u8 *src, u32 start, u32 end, s32 level, Writer &writer, bool showProgress) {
+        if (level == JKRCompressionLevel_STORE) {
+            for (u32 pos = start; pos < end; pos++)
+                writer.writeLiteral(src[pos]);
+        }
+        else if (level == JKRCompressionLevel_MAX && context.mFinderType == JKRMatchFinderType_SUFFIX_ARRAY)
+            encodeSZSOptimalParse(context, context.mSuffixFinder, src, start, end, writer, showProgress);
+        else if (level == JKRCompressionLevel_MAX) {
+            context.mFinder.mChainDepth = cSZSWindowSize;
+            encodeSZSOptimalParse(context, context.mFinder, src, start, end, writer, showProgress);
+        }
+        else {
+            const SZSLevelParams &params = cSZSLevelParams[level];
+            encodeSZSHashChain(context, src, start, end, params.mChainDepth, params.mLazy, writer, showProgress);
+        }
+    }
+
+    // What isWorthCompressing compresses of a large input to judge it
+    const u32 cProbeSampleCount = 8;
+    const u32 cProbeSampleSize = 0x2000;
+
+    s32 clampLevel(s32 level) {
+        return std::max<s32>(JKRCompressionLevel_STORE, std::min<s32>(level, JKRCompressionLevel_MAX));
+    }
+
+    // Splits the input into segments that are compressed on their own threads, each one primed with the
+    // 4 KB before it. The output only depends on the segment size, not on the number of threads.
+    // Every thread works with its own context, the calling thread uses pContext when one is given
+    // and the others take over its settings. Only the calling thread reports progress, when asked to.
+    template<typename Func>
+    void runSegments(u32 srcSize, u32 segmentSize, u32 threadCount, JKRCompressionContext *pContext, bool showProgress, Func encodeSegment) {
+        if (threadCount == 0)
+            threadCount = std::max<u32>(1, std::thread::hardware_concurrency());
+
+        u32 segmentCount = (srcSize + segmentSize - 1) / segmentSize;
+        std::atomic<u32> nextSegment(0);
+        std::atomic<u32> doneSegments(0);
+        std::atomic<bool> abandoned(false);
+        if (pContext)
+            pContext->mAbandoned = false;
+
+        // A single segment finishes in one go, e.g. a small file inside an archive
+        showProgress = showProgress && segmentCount > 1;
+        u32 percent = 0;
+        auto report = [&]() {
+            if (showProgress && doneSegments * 100 / segmentCount != percent) {
+                percent = doneSegments * 100 / segmentCount;
+                printf("\rProgress: %u%%", (unsigned)percent);
+            }
+        };
+
+        auto worker = [&](JKRCompressionContext &context, bool isCaller) {
+            for (u32 seg = nextSegment++; seg < segmentCount; seg = nextSegment++) {
+                u32 start = seg * segmentSize;
+                encodeSegment(context, seg, start, std::min(srcSize, start + segmentSize));
+                doneSegments++;
+
+                if (isCaller)
+                    report();
+            }
+        };
+
+        std::vector<std::thread> threads;
+        for (u32 i = 1; i < std::min(threadCount, segmentCount); i++) {
+            threads.emplace_back([&]() {
+                JKRCompressionContext context;
+                if (pContext)
+                    context.copySettings(*pContext);
+                worker(context, false);
+                if (context.mAbandoned)
+                    abandoned = true;
+            });
+        }
+
+        if (pContext)
+            worker(*pContext, true);
+        else {
+            JKRCompressionContext context;
+            worker(context, true);
+        }
+
+        // The other threads may still be on their last segments
+        while (showProgress && doneSegments < segmentCount) {
+            std::this_thread::sleep_for(std::chrono::milliseconds(50));
+            report();
+        }
+        for (auto &thread : threads)
+            thread.join();
+
+        // The caller only looks at its own context
+        if (pContext && abandoned)
+            pContext->mAbandoned = true;
+
+        if (showProgress)
+            printf("\n");
+    }
+
+    // Wide copies may write up to this many bytes past the end of a match
+    const u32 cSZSCopySlack = 16;
+
+    // Input and output a whole group may touch on the fast path, including the overrun of wide copies
+    const u32 cSZSFastGroupSrc = 1 + 8 * 3 + 8;
+    const u32 cSZSFastGroupDst = 8 * cSZSMaxMatch + cSZSCopySlack;
+
+    // Token layout of one group header: the literal runs before each match and after the last one
+    struct SZSFlagInfo {
+        u8 mMatchCount;
+        u8 mRuns[9];
+    };
+
+    struct SZSFlagTable {
+        SZSFlagTable() {
+            for (u32 flags = 0; flags < 0x100; flags++) {
+                SZSFlagInfo &info = mEntries[flags];
+                info.mMatchCount = 0;
+                std::fill(info.mRuns, info.mRuns + 9, 0);
+
+                for (s32 bit = 7; bit >= 0; bit--) {
+                    if (flags & (1 << bit))
+                        info.mRuns[info.mMatchCount]++;
+                    else
+                        info.mMatchCount++;
+                }
+            }
+        }
+
+        SZSFlagInfo mEntries[0x100];
+    };
+
+    const SZSFlagTable cSZSFlagTable;
+
+    // Copies a back-reference that lies at least 8 bytes behind, in whole 8 or 16 byte steps.
+    // Every step reads only bytes that are already final, so the overrun is overwritten later.
+    void copyMatchWide(u8 *out, const u8 *from, u32 dist, u32 count) {
+        u8* end = out + count;
+        if (dist >= 16) {
+            do {
+                memcpy(out, from, 16);
+                out += 16;
+                from += 16;
+            } while (out < end);
+        }
+        else {
+            do {
+                memcpy(out, from, 8);
+                out += 8;
+                from += 8;
+            } while (out < end);
+        }
+    }
+
+    // Expands one back-reference whose bounds the caller has already checked
+    u8* copyMatch(u8 *out, u8 *dstEnd, u32 dist, u32 count) {
+        const u8* from = out - dist;
+
+        // Short distances repeat a pattern, double it until the copy no longer overlaps itself
+        if (dist == 1) {
+            memset(out, *from, count);
+            return out + count;
+        }
+        while (dist < 8 && count > dist) {
+            memcpy(out, from, dist);
+            out += dist;
+            count -= dist;
+            dist *= 2;
+        }
+
+        if (dist >= 8 && (u32)(dstEnd - out) >= count + cSZSCopySlack)
+            copyMatchWide(out, from, dist, count);
+        else if (count <= dist)
+            memcpy(out, from, count);
+        else {
+            for (u32 i = 0; i < count; i++)
+                out[i] = from[i];
+        }
+        return out + count;
+    }
+
+    // Decodes the Yaz0 token stream into exactly dstSize bytes, returns false on corrupt or truncated input.
+    // The historySize bytes in front of dst are already decoded and may be referenced.
+    bool decodeSZSBody(const u8 *src, const u8 *srcEnd, u8 *dst, u32 dstSize, u32 historySize) {
+        u8* base = dst - historySize;
+        u8* out = dst;
+        u8* dstEnd = dst + dstSize;
+
+        // Fast path: while a whole group fits in both buffers only the match distance needs checking,
+        // and the flag table replaces the per-bit loop
+        while ((u32)(srcEnd - src) >= cSZSFastGroupSrc && (u32)(dstEnd - out) >= cSZSFastGroupDst) {
+            u8 block = *src++;
+
+            if (block == 0xFF) {
+                memcpy(out, src, 8);
+                out += 8;
+                src += 8;
+                continue;
+            }
+
+            const SZSFlagInfo &info = cSZSFlagTable.mEntries[block];
+            for (u32 i = 0; i < info.mMatchCount; i++) {
+                u32 run = info.mRuns[i];
+                if (run) {
+                    memcpy(out, src, 8);
+                    out += run;
+                    src += run;
+                }
+
+                u32 dist = (((src[0] & 0xF) << 8) | src[1]) + 1;
+                u32 count = src[0] >> 4;
+                src += 2;
+
+                if (count == 0)
+                    count = *src++ + 0x12;
+                else
+                    count += 2;
+
+                if (dist > (u32)(out - base))
+                    return false;
+                out = copyMatch(out, dstEnd, dist, count);
+            }
+
+            u32 run = info.mRuns[info.mMatchCount];
+            if (run) {
+                memcpy(out, src, 8);
+                out += run;
+                src += run;
+            }
+        }
+
+        // The last groups are decoded token by token with every read checked
+        while (out < dstEnd) {
+            if (src >= srcEnd)
+                return false;
+
+            u8 block = *src++;
+            for (s32 bit = 0; bit < 8 && out < dstEnd; bit++, block <<= 1) {
+                if (block & 0x80) {
+                    if (src >= srcEnd)
+                        return false;
+                    *out++ = *src++;
+                    continue;
+                }
+
+                if (srcEnd - src < 2)
+                    return false;
+
+                u32 dist = (((src[0] & 0xF) << 8) | src[1]) + 1;
+                u32 count = src[0] >> 4;
+                src += 2;
+
+                if (count == 0) {
+                    if (src >= srcEnd)
+                        return false;
+                    count = *src++ + 0x12;
+                }
+                else
+                    count += 2;
+
+                if (dist > (u32)(out - base) || count > (u32)(dstEnd - out))
+                    return false;
+                out = copyMatch(out, dstEnd, dist, count);
+            }
+        }
+
+        return true;
+    }
+
+    // Nothing expands by more than a longest match per two bytes of stream, in either format
+    u64 getMaxDecodedSize(u32 size) {
+        return (u64)(size - 0x10) * cSZSMaxMatch / 2;
+    }
+
+    // Decodes a Yay0 image into exactly dstSize bytes. The mask words, links and literal/count bytes
+    // live in three separate streams, each read through its own cursor and bounded by the input.
+    bool decodeSZPBody(const u8 *pData, u32 size, u8 *dst, u32 dstSize) {
+        u32 linkOffs = (pData[8] << 24) | (pData[9] << 16) | (pData[10] << 8) | pData[11];
+        u32 chunkOffs = (pData[12] << 24) | (pData[13] << 16) | (pData[14] << 8) | pData[15];
+
+        if (linkOffs > size || chunkOffs > size)
+            return false;
+
+        const u8* mask = pData + 0x10;
+        const u8* link = pData + linkOffs;
+        const u8* chunk = pData + chunkOffs;
+        const u8* srcEnd = pData + size;
+        u8* out = dst;
+        u8* dstEnd = dst + dstSize;
+
+        while (out < dstEnd) {
+            if (srcEnd - mask < 4)
+                return false;
+
+            u32 bits = (mask[0] << 24) | (mask[1] << 16) | (mask[2] << 8) | mask[3];
+            mask += 4;
+
+            // A word of nothing but literals is one straight copy out of the chunk stream
+            if (bits == 0xFFFFFFFF && srcEnd - chunk >= 32 && dstEnd - out >= 32) {
+                memcpy(out, chunk, 32);
+                out += 32;
+                chunk += 32;
+                continue;
+            }
+
+            for (s32 bit = 0; bit < 32 && out < dstEnd; bit++, bits <<= 1) {
+                if (bits & 0x80000000) {
+                    if (chunk >= srcEnd)
+                        return false;
+                    *out++ = *chunk++;
+                    continue;
+                }
+
+                if (srcEnd - link < 2)
+                    return false;
+
+                u32 dist = (((link[0] & 0xF) << 8) | link[1]) + 1;
+                u32 count = link[0] >> 4;
+                link += 2;
+
+                if (count == 0) {
+                    if (chunk >= srcEnd)
+                        return false;
+                    count = *chunk++ + 0x12;
+                }
+                else
+                    count += 2;
+
+                if (dist > (u32)(out - dst) || count > (u32)(dstEnd - out))
+                    return false;
+                out = copyMatch(out, dstEnd, dist, count);
+            }
+        }
+
+        return true;
+    }
+};
 
 namespace JKRCompression {
     JKRCompressionType checkCompression(const std::string &filePath) {
         BinaryReader reader(filePath, EndianSelect::Big);
         std::string magic = reader.readString(0x4);
+        return checkCompression((const u8*)magic.data(), magic.size());
+    }
+
+    JKRCompressionType checkCompression(const u8 *pData, u32 size, bool verbose) {
+        std::string magic((const char*)pData, std::min<u32>(size, 0x4));
 
         if (magic == "Yaz0") {
-            printf("SZS compression found!\n");
+            if (verbose)
+                printf("SZS compression found!\n");
             return JKRCompressionType_SZS;
         }      
         else if (magic == "Yay0") {
-            printf("SZP compression found!\n");
+            if (verbose)
+                printf("SZP compression found!\n");
             return JKRCompressionType_SZP;
         }         
         else {
-            reader.seek(0, std::ios::beg);
-
-            if (reader.readString(0x3) == "ASR") {
-                printf("ASR compression found!\n");
+            if (magic.substr(0, 0x3) == "ASR") {
+                if (verbose)
+                    printf("ASR compression found!\n");
                 return JKRCompressionType_ASR;
             }     
         }
-        printf("No compression found!\n");
+        if (verbose)
+            printf("No compression found!\n");
         return JKRCompressionType_NONE;
     }
 
     u8* decode(const std::string &filePath, u32 *bufferSize) {
-        JKRCompressionType compType = checkCompression(filePath);
+        JKRCompressionType compType;
         u32 size;
+        u8* pData = decodeFile(filePath, &size, &compType);
+
+        if (compType == JKRCompressionType_NONE) {
+            delete [] pData;
+            return nullptr;
+        }
+
         *bufferSize = size;
-        u8* pData = File::readAllBytes(filePath, &size);
+        return pData;
+    }
+
+    // Opens the file once and sniffs it from the first chunk read. Yaz0 is decoded as it streams in so the
+    // compressed image is never held in full, anything else is read whole behind that chunk, then Yay0 is
+    // decoded in memory and uncompressed data is handed back as it is, with the type telling them apart.
+    // A Yaz0 file with an index next to it is read whole too, so the index's spans decode on threadCount threads.
+    u8* decodeFile(const std::string &filePath, u32 *pSize, JKRCompressionType *pType, u32 threadCount) {
+        std::ifstream stream(filePath, std::ifstream::in | std::ifstream::binary);
+        if (!stream) {
+            printf("Fatal error! Can't open %s\n", filePath.c_str());
+            exit(1);
+        }
+
+        std::vector<u8> chunk(cSZSFileChunkSize);
+        stream.read((char*)chunk.data(), chunk.size());
+        u32 chunkSize = stream.gcount();
+
+        *pType = checkCompression(chunk.data(), chunkSize);
+        JKRSZSIndex index;
+
+        if (*pType == JKRCompressionType_SZS && !index.load(JKRSZSIndex::getSidecarPath(filePath)))
+            return decodeSZSStream(stream, chunk, chunkSize, pSize);
+
+        if (*pType == JKRCompressionType_ASR) {
+            printf("Compression type: JKRCompressionType_ASR not supported!\n");
+            exit(1);
+        }
+
+        stream.clear();
+        stream.seekg(0, std::ios::end);
+        u32 fileSize = stream.tellg();
+        u8* pData = new u8[fileSize];
+        memcpy(pData, chunk.data(), chunkSize);
+        stream.seekg(chunkSize, std::ios::beg);
+        stream.read((char*)pData + chunkSize, fileSize - chunkSize);
+
+        if (*pType == JKRCompressionType_NONE) {
+            *pSize = fileSize;
+            return pData;
+        }
+
+        if (fileSize < 0x10) {
+            printf("Fatal error! Compressed file is truncated\n");
+            exit(1);
+        }
+
+        u8* pDecoded = nullptr;
+        *pSize = (pData[4] << 24) | (pData[5] << 16) | (pData[6] << 8) | pData[7];
+
+        // A stale index is only a missed speed-up, the file is decoded in one go then
+        if (*pType == JKRCompressionType_SZS) {
+            printf("Decompressing with index!\n");
+            if (index.mDecompSize == *pSize)
+                pDecoded = index.decodeParallel(pData, fileSize, threadCount);
+            if (!pDecoded)
+                pDecoded = decodeSZS(pData, fileSize);
+        }
+        else {
+            printf("Decompressing!\n");
+            pDecoded = decodeSZP(pData, fileSize);
+        }
+
+        delete [] pData;
+        return pDecoded;
+    }
+
+    // Sniffs and decodes an in-memory image, returns nullptr if it isn't compressed
+    u8* decode(const u8 *pData, u32 size, u32 *bufferSize) {
+        JKRCompressionType compType = checkCompression(pData, size);
+
+        if (compType == JKRCompressionType_SZS || compType == JKRCompressionType_SZP) {
+            if (size < 0x10) {
+                printf("Fatal error! Compressed file is truncated\n");
+                exit(1);
+            }
+            *bufferSize = (pData[4] << 24) | (pData[5] << 16) | (pData[6] << 8) | pData[7];
+        }
 
         switch (compType) {
             case JKRCompressionType_NONE:
@@ -50,25 +785,65 @@ namespace JKRCompression {
         return nullptr;
     }
 
-    void encode(const std::string &filePath, JKRCompressionType CompType, bool fast) {
+    // Settings that change the output besides the level are part of the name payloads are cached under
+    std::string getCacheEncoderName(JKRCompressionType type, s32 level, const JKRCompressionContext *pContext) {
+        std::string name = type == JKRCompressionType_SZS ? "SZS" : "SZP";
+
+        // Only the optimal parse of the top level has a choice of match finder, without a context it's the suffix array
+        if (clampLevel(level) == JKRCompressionLevel_MAX)
+            name += pContext && pContext->mFinderType == JKRMatchFinderType_HASH_CHAIN ? "-hc" : "-sa";
+
+        if (pContext && pContext->mMatchPenalty)
+            name += "-p" + std::to_string(pContext->mMatchPenalty);
+        return name;
+    }
+
+    void encode(const std::string &filePath, JKRCompressionType CompType, s32 level, JKRCompressionCache* pCache, u32 threadCount, JKRCompressionContext* pContext) {
         u32 srcSize;
-        u32 dstSize;
         u8* src = File::readAllBytes(filePath, &srcSize);
+        encode(filePath, src, srcSize, CompType, level, pCache, threadCount, pContext);
+        delete [] src;
+    }
+
+    // Compresses an in-memory image and writes the result to filePath in one go
+    void encode(const std::string &filePath, u8* src, u32 srcSize, JKRCompressionType CompType, s32 level, JKRCompressionCache* pCache, u32 threadCount, JKRCompressionContext* pContext) {
+        u32 dstSize;
         const u8* dst;
 
+        if (level != JKRCompressionLevel_STORE && !isWorthCompressing(src, srcSize, pContext)) {
+            printf("Warning! The data doesn't compress, writing it with the cheapest framing instead\n");
+            level = JKRCompressionLevel_STORE;
+        }
+
         switch (CompType) {
             case JKRCompressionType_SZS:
-                    if (fast) {
-                        dst = encodeSZSFast(src, srcSize, &dstSize);
-                    } else {
-                        dst = encodeSZS(src, srcSize, &dstSize);
+                    if (pCache && (dst = pCache->load(src, srcSize, getCacheEncoderName(CompType, level, pContext), level, &dstSize))) {
+                        printf("Using cached compression!\n");
+                        break;
                     }
+
+                    // A single thread without a cache to fill streams to the file, the output is never held in full
+                    if (threadCount == 1 && !pCache) {
+                        encodeSZSFile(filePath, src, srcSize, level, pContext);
+                        return;
+                    }
+
+                    dst = encodeSZSParallel(src, srcSize, &dstSize, level, threadCount, cSZSSegmentSize, pContext, true);
+
+                    if (pCache)
+                        pCache->store(src, srcSize, getCacheEncoderName(CompType, level, pContext), level, dst, dstSize);
+                    break;
+            case JKRCompressionType_SZP:
+                    if (pCache && (dst = pCache->load(src, srcSize, getCacheEncoderName(CompType, level, pContext), level, &dstSize))) {
+                        printf("Using cached compression!\n");
+                        break;
+                    }
+
+                    dst = encodeSZP(src, srcSize, &dstSize, level, threadCount, cSZSSegmentSize, pContext, true);
+
+                    if (pCache)
+                        pCache->store(src, srcSize, getCacheEncoderName(CompType, level, pContext), level, dst, dstSize);
                     break;
-            case JKRCompressionType_SZP: 
-                if (fast)
-                    printf("Fast compression doesn't exist for JKRCompressionType_SZP! Using normal compression\n");
-                encodeSZP(filePath);
-                break;
             case JKRCompressionType_ASR:
                 printf("Compression type: JKRCompressionType_ASR not supported!\n");
                 exit(1);
@@ -76,362 +851,312 @@ namespace JKRCompression {
         }
 
         File::writeAllBytes(filePath, dst, dstSize);
+        delete [] dst;
     }
     
+    // Pushes the input through JKRSZSEncoder a block at a time and writes out what it finished after each,
+    // the file is the same as encodeSZSParallel would produce with the same segment size
+    void encodeSZSFile(const std::string &filePath, const u8 *src, u32 srcSize, s32 level, JKRCompressionContext *pContext) {
+        std::ofstream stream(filePath, std::ofstream::out | std::ofstream::binary);
+        JKRSZSEncoder encoder(srcSize, level, cSZSSegmentSize, pContext);
+        std::vector<u8> chunk(cSZSFileChunkSize);
+
+        u32 pos = 0;
+        do {
+            u32 count = std::min<u32>(srcSize - pos, cSZSSegmentSize);
+            encoder.write(src + pos, count);
+            pos += count;
+
+            if (pos == srcSize)
+                encoder.finish();
+
+            while (u32 size = encoder.read(chunk.data(), chunk.size()))
+                stream.write((const char*)chunk.data(), size);
+        } while (pos < srcSize);
+    }
+
     u8* decodeSZS(const u8*pData, u32 bufferSize) {
-        BinaryReader reader(pData, bufferSize, EndianSelect::Big);
-        reader.skip(0x4);
+        if (bufferSize < 0x10 || memcmp(pData, "Yaz0", 4)) {
+            printf("Invalid identifier! Expected Yaz0\n");
+            return nullptr;
+        }
+
+        u32 decompSize;
+        u8* dst = tryDecodeSZS(pData, bufferSize, &decompSize);
+
+        if (!dst) {
+            printf("Fatal error! Yaz0 data is corrupt or truncated\n");
+            exit(1);
+        }
+
+        return dst;
+    }
+
+    // Same as decodeSZS but returns nullptr on bad data instead of exiting, for callers that can skip
+    // a broken stream, e.g. worker threads. The header's size has to be one the stream can expand to
+    // before anything is allocated for it, and decoding has to fill it exactly.
+    u8* tryDecodeSZS(const u8 *pData, u32 bufferSize, u32 *pDecompSize) {
+        if (bufferSize < 0x10 || memcmp(pData, "Yaz0", 4))
+            return nullptr;
+
+        u32 decompSize = (pData[4] << 24) | (pData[5] << 16) | (pData[6] << 8) | pData[7];
+        if (decompSize > getMaxDecodedSize(bufferSize))
+            return nullptr;
 
-        u32 decompSize = reader.read<u32>();
-        reader.skip(0x8);
         u8* dst = new u8[decompSize];
-        u32 dstPos = 0;
+        if (!decodeSZSBody(pData + 0x10, pData + bufferSize, dst, decompSize, 0)) {
+            delete [] dst;
+            return nullptr;
+        }
 
-        u32 validBitCount = 0;
-        u8 block = 0;
+        *pDecompSize = decompSize;
+        return dst;
+    }
 
-        while (dstPos < bufferSize) {
-            if (validBitCount == 0) {
-                block = reader.read<u8>();
-                validBitCount = 8;
-            }
+    // Decodes a token range that starts on a group boundary and ends on a token boundary, the historySize
+    // bytes before dst must hold the output that precedes the range
+    bool decodeSZSRange(const u8 *src, const u8 *srcEnd, u8 *dst, u32 dstSize, u32 historySize) {
+        return decodeSZSBody(src, srcEnd, dst, dstSize, historySize);
+    }
 
-            if ((block & 0x80) != 0) {
-                dst[dstPos] = reader.read<u8>();
-                dstPos++;
+    // Streams the file through the decoder in small chunks, so only the output is ever held in full
+    u8* decodeSZSFile(const std::string &filePath, u32 *bufferSize) {
+        std::ifstream stream(filePath, std::ifstream::in | std::ifstream::binary);
+        std::vector<u8> chunk(cSZSFileChunkSize);
+        return decodeSZSStream(stream, chunk, 0, bufferSize);
+    }
+
+    // Decodes what's left of the stream, with chunkSize bytes of it already read into the chunk
+    u8* decodeSZSStream(std::ifstream &stream, std::vector<u8> &chunk, u32 chunkSize, u32 *bufferSize) {
+        JKRSZSDecoder decoder;
+        u8* dst = nullptr;
+        u32 dstPos = 0;
+        JKRStreamStatus status = JKRStreamStatus_NEED_INPUT;
+
+        printf("Decompressing!\n");
+        while (status == JKRStreamStatus_NEED_INPUT && (chunkSize || stream)) {
+            if (!chunkSize) {
+                stream.read((char*)chunk.data(), chunk.size());
+                chunkSize = stream.gcount();
             }
-            else {
-                u8 byte1 = reader.read<u8>();
-                u8 byte2 = reader.read<u8>();
+            u32 chunkPos = 0;
 
-                u32 copySrc = dstPos - ((((byte1 & 0xF) << 8) | byte2) + 1);
-                u32 numBytes = byte1 >> 4;
+            while (status == JKRStreamStatus_NEED_INPUT && chunkPos < chunkSize) {
+                u32 used;
+                u32 written;
 
-                if (numBytes == 0) 
-                    numBytes = reader.read<u8>() + 0x12;
-                else 
-                    numBytes += 2;
+                // Until the header is in there is nothing to write to, the decoder only consumes it
+                status = decoder.decode(chunk.data() + chunkPos, chunkSize - chunkPos, &used, dst + dstPos, dst ? decoder.getDecompressedSize() - dstPos : 0, &written);
+                chunkPos += used;
+                dstPos += written;
 
-                for (s32 i = 0; i < numBytes; i++) {
-                    dst[dstPos] = dst[copySrc];
-                    copySrc++;
-                    dstPos++;
+                if (!dst && decoder.hasHeader()) {
+                    dst = new u8[decoder.getDecompressedSize()];
+                    if (status == JKRStreamStatus_NEED_OUTPUT)
+                        status = JKRStreamStatus_NEED_INPUT;
                 }
             }
+            chunkSize = 0;
+        }
 
-            block <<= 1;
-            validBitCount--;
+        if (status != JKRStreamStatus_DONE) {
+            printf("Fatal error! Yaz0 data is corrupt or truncated\n");
+            exit(1);
         }
 
+        *bufferSize = dstPos;
         return dst;
     }
 
     u8* decodeSZP(const u8*pData, u32 bufferSize) {
-        BinaryReader* reader = new BinaryReader(pData, bufferSize, EndianSelect::Big);
-        if (reader->readString(0x4) != "Yay0") {
+        if (bufferSize < 0x10 || memcmp(pData, "Yay0", 4)) {
             printf("Invalid identifier! Expected Yay0\n");
             return nullptr;
         }
 
-        u32 decompSize = reader->read<u32>();
-        u32 linkTableOffs = reader->read<u32>();
-        u32 byteChunkAndCountModiferOffset = reader->read<u32>();
+        u32 decompSize;
+        u8* dst = tryDecodeSZP(pData, bufferSize, &decompSize);
 
-        u8* dst = new u8[decompSize];
-        s32 maskedBitCount = 0;
-        s32 curOffsInDst = 0;
-        s32 curMask = 0;
-
-        while (curOffsInDst < decompSize) {
-            if (maskedBitCount == 0) {
-                curMask = reader->read<s32>();
-                maskedBitCount = 32;
-            }
+        if (!dst) {
+            printf("Fatal error! Yay0 data is corrupt or truncated\n");
+            exit(1);
+        }
 
-            if (((u32)curMask & (u32)0x80000000) == 0x80000000) {
-                u32 curPos = reader->position();
-                reader->seek(byteChunkAndCountModiferOffset++, std::ios::beg);
-                dst[curOffsInDst++] = reader->read<u8>();
-                reader->seek(curPos, std::ios::beg);
-            }
-            else {
-                u64 curPos = reader->position();
-                reader->seek(linkTableOffs++, std::ios::beg);
-                u16 link = reader->read<u16>();
-                linkTableOffs += 2;
-                reader->seek(curPos, std::ios::beg);
+        return dst;
+    }
 
-                s32 offset = curOffsInDst - (link & 0xFFF);
-                s32 count = link >> 0xC;
+    u8* tryDecodeSZP(const u8 *pData, u32 bufferSize, u32 *pDecompSize) {
+        if (bufferSize < 0x10 || memcmp(pData, "Yay0", 4))
+            return nullptr;
 
-                if (count == 0) {
-                    u64 curPos = reader->position();
-                    reader->seek(byteChunkAndCountModiferOffset++, std::ios::beg);
-                    u8 countModifer = reader->read<u8>();
-                    reader->seek(curPos, std::ios::beg);
-                    count += countModifer + 0x12;
-                }
-                else {
-                    count += 2;
-                }
+        u32 decompSize = (pData[4] << 24) | (pData[5] << 16) | (pData[6] << 8) | pData[7];
+        if (decompSize > getMaxDecodedSize(bufferSize))
+            return nullptr;
 
-                s32 blockCopy = offset;
+        u8* dst = new u8[decompSize];
+        if (!decodeSZPBody(pData, bufferSize, dst, decompSize)) {
+            delete [] dst;
+            return nullptr;
+        }
 
-                for (s32 i = 0; i < count; i++) {
-                    dst[curOffsInDst++] = dst[blockCopy++ -1];
-                }
-            }
+        *pDecompSize = decompSize;
+        return dst;
+    }
 
-            curMask <<= 1;
-            maskedBitCount--;
+    const u8* encodeSZS(u8* src, u32 srcSize, u32 *outSize, s32 level, bool showProgress, JKRCompressionContext *pContext) {
+        level = clampLevel(level);
+
+        if (level == JKRCompressionLevel_STORE)
+            return encodeSZSStore(src, srcSize, outSize);
+
+        std::unique_ptr<JKRCompressionContext> ownContext;
+        if (!pContext) {
+            ownContext.reset(new JKRCompressionContext());
+            pContext = ownContext.get();
         }
 
-        reader->~BinaryReader();
+        u8* dst = allocSZS(srcSize);
+        JKRSZSGroupWriter writer(dst + 0x10);
+        pContext->mAbandoned = false;
+        encodeSZSRange(*pContext, src, 0, srcSize, level, writer, showProgress);
+
+        if (showProgress)
+            printf("\n");
+
+        *outSize = 0x10 + writer.mPos;
         return dst;
     }
 
-    const u8* encodeSZS(u8* src, u32 srcSize, u32 *outSize) {
-        BinaryWriter writer(src, srcSize, EndianSelect::Little);
-        writer.writeString("Yaz0");
-        //return writer.getBuffer();
-        writer.write<u32>(srcSize);
-        writer.writePadding(0x0, 8);
-        u8 dst[24];
-        s32 srcPos = 0;
-        s32 dstPos = 0;
-        s32 dstSize = 0;
-        s32 percent = 0;
-
-        u32 validBitCount = 0;
-        u8 currCodeByte = 0;
-        while(srcPos < srcSize) {
-            u32 numBytes;
-            u32 matchPos;
-            u32 srcPosBak;
-
-            numBytes = encodeAdvancedSZS(src, srcSize, srcPos, &matchPos);
-            if (numBytes < 3) {
-                dst[dstPos] = src[srcPos];
-                dstPos++;
-                srcPos++;
-                currCodeByte |= (0x80 >> validBitCount);
-            }
-            else {
-                u32 dist = srcPos - matchPos - 1; 
-                u8 byte1, byte2, byte3;
-
-                if (numBytes >= 0x12) {
-                    byte1 = 0 | (dist >> 8);
-                    byte2 = dist & 0xff;
-                    dst[dstPos++] = byte1;
-                    dst[dstPos++] = byte2;
-
-                    if (numBytes > 0xff + 0x12)
-                        numBytes = 0xff + 0x12;
-                        
-                    byte3 = numBytes - 0x12;
-                    dst[dstPos++] = byte3;
-                } 
-                else {
-                    byte1 = ((numBytes - 2) << 4) | (dist >> 8);
-                    byte2 = dist & 0xff;
-                    dst[dstPos++] = byte1;
-                    dst[dstPos++] = byte2; 
-                }
-                srcPos += numBytes;
-            }
-            validBitCount++;
+    const u8* encodeSZSParallel(u8* src, u32 srcSize, u32 *outSize, s32 level, u32 threadCount, u32 segmentSize, JKRCompressionContext *pContext, bool showProgress) {
+        level = clampLevel(level);
 
-            if (validBitCount == 8) {
-                writer.write<u8>(currCodeByte);
+        if (level == JKRCompressionLevel_STORE)
+            return encodeSZSStore(src, srcSize, outSize);
 
-                writer.writeBytes(dst, dstPos);
-                dstSize += dstPos + 1;
+        segmentSize = std::max<u32>(segmentSize, cSZSWindowSize);
+        std::vector<JKRSZSGroupWriter> segments((srcSize + segmentSize - 1) / segmentSize, JKRSZSGroupWriter(nullptr));
 
-                currCodeByte = 0;
-                validBitCount = 0;
-                dstPos = 0;
-            }
+        runSegments(srcSize, segmentSize, threadCount, pContext, showProgress, [&](JKRCompressionContext &context, u32 seg, u32 start, u32 end) {
+            segments[seg].mDst = new u8[(end - start) + (end - start) / 8 + 1];
+            encodeSZSRange(context, src, start, end, level, segments[seg], false);
+        });
 
-            if ((srcPos + 1) * 100 / srcSize != percent) {
-                percent = (srcPos + 1) * 100 / srcSize;
-                printf("\rProgress: %u%%", percent);
-            }
+        u8* dst = allocSZS(srcSize);
+        JKRSZSGroupWriter writer(dst + 0x10);
+        for (auto &segment : segments) {
+            writer.append(segment);
+            delete [] segment.mDst;
         }
-        if (validBitCount > 0) {
-            writer.write<u8>(currCodeByte);
-            writer.writeBytes(dst, dstPos);
-            dstSize += dstPos + 1;
 
-            currCodeByte = 0;
-            validBitCount = 0;
-            dstPos = 0;
-        }
-        printf("\n");
-        *outSize = dstSize;
-        std::cout << src[0] << '\n';
-        return writer.getBuffer();
+        *outSize = 0x10 + writer.mPos;
+        return dst;
     }
 
-    // This is faster, but the files it produces are larger
-    const u8* encodeSZSFast(u8*src, u32 srcSize, u32 *pDstSize) {
-        u32 pos = 0;
-        u8* dst = new u8[srcSize + srcSize / 8 + 0x10];
-
-        dst[pos++] = 'Y';
-        dst[pos++] = 'a';
-        dst[pos++] = 'z';
-        dst[pos++] = '0';
-        dst[pos++] = ((srcSize >> 24) & 0xFF);
-        dst[pos++] = ((srcSize >> 16) & 0xFF);
-        dst[pos++] = ((srcSize >> 8) & 0xFF);
-        dst[pos++] = ((srcSize >> 0) & 0xFF);
-
-        for (s32 i = 0; i < 8; i++) dst[pos++] = 0;
-        s32 length = srcSize;
-        s32 dstOffs = 16;
-        s32 offs = 0;
-
-        while (true) {
-            s32 headerOffs = dstOffs++;
-            pos++;
-            u8 header = 0;
-            for (s32 i = 0; i < 8; i++) {
-                s32 comp = 0;
-                s32 back = 1;
-                s32 nr = 2;
-                {
-                    u8* ptr = src - 1;
-                    s32 maxnum = 0x111;
-                    if (length - offs < maxnum) maxnum = length - offs;
-
-                    s32 maxback = 0x400;
-                    if (offs < maxback) maxback = offs;
-                    maxback = *(s32*)src - maxback;
-                    s32 tmpnr;
-                    while (maxback <= *(s32*)ptr) {
-                        if (*(u16*)ptr == *(u16*)src && ptr[2] == src[2]) {
-                            tmpnr = 3;
-                            while (tmpnr < maxnum && ptr[tmpnr] == src[tmpnr]) tmpnr++;
-                            if (tmpnr > nr) {
-                                if (offs + tmpnr > length) {
-                                    nr = length - offs;
-                                    back = (s32)(src - ptr);
-                                    break;
-                                }
-                                nr = tmpnr;
-                                back = (s32)(src - ptr);
-                                if (nr == maxnum) break;
-                            }
-                        }
-                        --ptr;
-                    }
-                }
-                if (nr > 2) {
-                    offs += nr;
-                    src += nr;
-                    if (nr >= 0x12) {
-                        dst[pos++] = (u8)(((back -1) >> 8) & 0xF);
-                        dst[pos++] = (u8)((back - 1) & 0xFF);
-                        dst[pos++] = (u8)((nr - 0x12) & 0xFF);
-                        dstOffs +=3;
-                    }
-                    else {
-                        dst[pos++] = (u8)((((back - 1) >> 8) & 0xF) | (((nr - 2) & 0xF) << 4));
-                        dst[pos++] = (u8)((back - 1) & 0xFF);
-                        dstOffs += 2;
-                    }
-                    comp = 1;
-                }
-                else {
-                    dst[pos++] = *src++;
-                    dstOffs++;
-                    offs++;
-                }
-                header = (u8)((header << 1) | ((comp == 1) ? 0 : 1));
-                if (offs >= length) {
-                    header = (u8)(header << (7 - i));
-                    break;
-                }
-            }
-            dst[headerOffs] = header;
-            if (offs >= length) break;
+    // Compresses [start, end) of src into the writer, the 4 KB before start only serves as history
+    void encodeSZSBlock(const u8* src, u32 start, u32 end, s32 level, JKRSZSGroupWriter &writer, JKRCompressionContext &context) {
+        encodeSZSRange(context, src, start, end, clampLevel(level), writer, false);
+    }
+
+    // Compresses evenly spread samples of a large input with the level 1 parser and checks they shrink.
+    // Yaz0 and Yay0 only have back-references and no entropy coding, so the byte distribution alone
+    // says little about it. Small inputs are cheaper to just compress and check afterwards.
+    bool isWorthCompressing(const u8 *src, u32 srcSize, JKRCompressionContext *pContext) {
+        if (srcSize <= cProbeSampleCount * cProbeSampleSize * 2)
+            return true;
+
+        JKRCompressionContext localContext;
+        JKRCompressionContext &context = pContext ? *pContext : localContext;
+        std::vector<u8> buffer(cProbeSampleSize + cProbeSampleSize / 8 + 1);
+        u32 compressedSize = 0;
+
+        for (u32 i = 0; i < cProbeSampleCount; i++) {
+            u32 start = (u64)(srcSize - cProbeSampleSize) * i / (cProbeSampleCount - 1);
+            JKRSZSGroupWriter writer(buffer.data());
+            encodeSZSHashChain(context, src, start, start + cProbeSampleSize, 1, false, writer, false);
+            compressedSize += writer.mPos;
         }
-        while ((dstOffs % 4) != 0) dstOffs++;
-        *pDstSize = dstOffs;
-        return dst;
+
+        return compressedSize < cProbeSampleCount * cProbeSampleSize;
     }
 
-    u32 encodeSimpleSZS(u8*src, s32 size, s32 pos, u32 *pMatchPos) {
-        s32 startPos = pos - 0x1000;
-        u32 byteCount = 1;
-        u32 matchPos = 0;
+    // Levels tried by encodeWithBudget in order, each one is a few times the work of the one before
+    const s32 cBudgetLevels[] = { 1, JKRCompressionLevel_FAST, 4, JKRCompressionLevel_DEFAULT, JKRCompressionLevel_MAX };
 
-        if (startPos < 0) {
-            startPos = 0;
+    // Compresses with an escalating match search and returns the smallest stream found. The first level
+    // always completes, later ones only count if they finish before the given number of seconds is up.
+    // maxSteps limits how many levels are tried, without a time limit the output then only depends on the input.
+    const u8* encodeWithBudget(u8* src, u32 srcSize, u32 *outSize, JKRCompressionType type, double seconds, u32 maxSteps, u32 threadCount, JKRCompressionContext *pContext) {
+        JKRCompressionContext localContext;
+        JKRCompressionContext &context = pContext ? *pContext : localContext;
+        auto deadline = std::chrono::steady_clock::time_point::max();
+        if (seconds > 0)
+            deadline = std::chrono::steady_clock::now() + std::chrono::duration_cast<std::chrono::steady_clock::duration>(std::chrono::duration<double>(seconds));
+
+        u32 stepCount = sizeof(cBudgetLevels) / sizeof(cBudgetLevels[0]);
+        if (maxSteps)
+            stepCount = std::min(stepCount, maxSteps);
+
+        if (!isWorthCompressing(src, srcSize, &context)) {
+            printf("Warning! The data doesn't compress, writing it with the cheapest framing instead\n");
+            return type == JKRCompressionType_SZP ? encodeSZP(src, srcSize, outSize, JKRCompressionLevel_STORE) :
+                encodeSZSParallel(src, srcSize, outSize, JKRCompressionLevel_STORE);
         }
 
-        for (s32 i = startPos; i < pos; i++) {
-            s32 y;
-            for (y = 0; y < size; y++) {
-                if (src[i + y] != src[y + pos]) {
-                    break;
-                }
+        const u8* best = nullptr;
+        for (u32 step = 0; step < stepCount; step++) {
+            context.mDeadline = step ? deadline : std::chrono::steady_clock::time_point::max();
+            if (context.isPastDeadline())
+                break;
+
+            s32 level = cBudgetLevels[step];
+            u32 size;
+            const u8* dst = type == JKRCompressionType_SZP ? encodeSZP(src, srcSize, &size, level, threadCount, cSZSSegmentSize, &context) :
+                encodeSZSParallel(src, srcSize, &size, level, threadCount, cSZSSegmentSize, &context);
+
+            // A level that ran into the deadline stopped halfway, one that finished just before it still counts
+            if (context.mAbandoned) {
+                delete [] dst;
+                break;
             }
 
-            if (y > byteCount) {
-                byteCount = y;
-                matchPos = i;
+            printf("Level %d: %u bytes\n", (int)level, (unsigned)size);
+            if (best && size >= *outSize) {
+                delete [] dst;
+                continue;
             }
-        }
-        *pMatchPos = matchPos;
 
-        if (byteCount == 2) {
-            byteCount = 1;
+            delete [] best;
+            best = dst;
+            *outSize = size;
         }
-        return byteCount;
-    }
 
-    u32 encodeAdvancedSZS(u8* src, s32 size, s32 pos, u32 *pMatchPos)
-    {
-        s32 startPos = pos - 0x1000;
-        u32 numBytes = 1;
-        static u32 numBytes1;
-        static u32 matchPos;
-        static s32 prevFlag = 0;
+        context.mDeadline = std::chrono::steady_clock::time_point::max();
+        return best;
+    }
 
-        if (prevFlag == 1) {
-            *pMatchPos = matchPos;
-            prevFlag = 0;
-            return numBytes1;
-        }
-        prevFlag = 0;
-        numBytes = encodeSimpleSZS(src, size, pos, &matchPos);
-        *pMatchPos = matchPos;
+    // Slowest, but produces the smallest stream possible with Yaz0's token costs
+    const u8* encodeSZSOptimal(u8* src, u32 srcSize, u32 *outSize) {
+        return encodeSZS(src, srcSize, outSize, JKRCompressionLevel_MAX, true);
+    }
 
-        if (numBytes >= 3) {
-            numBytes1 = encodeSimpleSZS(src, size, pos + 1, &matchPos);
-            if (numBytes1 >= numBytes+2) {
-                numBytes = 1;
-                prevFlag = 1;
-            }
-        }
-        return numBytes;
+    // This is faster, but the files it produces are larger
+    const u8* encodeSZSFast(u8*src, u32 srcSize, u32 *pDstSize) {
+        return encodeSZS(src, srcSize, pDstSize, JKRCompressionLevel_FAST, false);
     }
 
-    void encodeSZP(const std::string &filePath) {
-        printf("Compression type: JKRCompressionType_SZP not implemented!\n");
-        exit(1);
-        u32 size;
-        u8* src = File::readAllBytes(filePath, &size);
-        BinaryWriter* writer = new BinaryWriter(filePath, EndianSelect::Big);
-        writer->writeString("Yay0");
-        writer->write<u32>(size);
-        u32 srcPos = 0;
-        u32 dstPos = 0;
+    // Same parsers and levels as Yaz0, only the tokens are split over Yay0's mask, link and chunk streams
+    const u8* encodeSZP(u8* src, u32 srcSize, u32 *outSize, s32 level, u32 threadCount, u32 segmentSize, JKRCompressionContext *pContext, bool showProgress) {
+        level = clampLevel(level);
+        segmentSize = std::max<u32>(segmentSize, cSZSWindowSize);
+        std::vector<SZPStreamWriter> segments((srcSize + segmentSize - 1) / segmentSize);
 
-        while (srcPos < size) {
-            
-        }
+        runSegments(srcSize, segmentSize, threadCount, pContext, showProgress, [&](JKRCompressionContext &context, u32 seg, u32 start, u32 end) {
+            encodeSZSRange(context, src, start, end, level, segments[seg], false);
+        });
+
+        SZPStreamWriter writer;
+        for (auto &segment : segments)
+            writer.append(segment);
+        return writer.finish(srcSize, outSize);
     }
 };
\ No newline at end of file
@@ -0,0 +1,238 @@
+#include "..\Include\JKRCompressionCache.h"
+#include "..\Include\BinaryReaderAndWriter.h"
+#include "..\Include\filesystem.hpp"
+#include <chrono>
+#include <random>
+
+namespace {
+    // Bump whenever the entry layout or what a level produces changes so old caches are simply missed
+    const char* cCacheVersion = "v3";
+    const u64 cHashPrime = 0x9E3779B97F4A7C15;
+
+    u64 mixHash(u64 hash, u64 val) {
+        hash ^= val + cHashPrime + (hash << 6) + (hash >> 2);
+        hash *= 0xBF58476D1CE4E5B9;
+        return hash ^ (hash >> 31);
+    }
+
+    bool isHexRun(const std::string &str, u32 pos, u32 count) {
+        if (pos + count > str.size())
+            return false;
+
+        for (u32 i = pos; i < pos + count; i++) {
+            if (!isxdigit((u8)str[i]))
+                return false;
+        }
+        return true;
+    }
+
+    // Names made by getEntryPath of any version, "v<N>-<hash 32>-<size 8>-<encoder>-<level>.bin".
+    // Nothing else in the directory is counted or touched, it may well be shared with other files.
+    bool isCacheEntryName(const std::string &name) {
+        u32 pos = 1;
+        if (name.empty() || name[0] != 'v')
+            return false;
+        while (pos < name.size() && isdigit((u8)name[pos]))
+            pos++;
+
+        if (pos == 1 || pos >= name.size() || name[pos] != '-' || !isHexRun(name, pos + 1, 32))
+            return false;
+        pos += 33;
+
+        if (pos >= name.size() || name[pos] != '-' || !isHexRun(name, pos + 1, 8))
+            return false;
+        pos += 9;
+
+        return pos < name.size() && name[pos] == '-' && name.size() > pos + 4 && !name.compare(name.size() - 4, 4, ".bin");
+    }
+
+    // Leftovers of store, an entry name followed by ".<random 16>.tmp"
+    bool isCacheTempName(const std::string &name) {
+        const u32 suffixSize = 21;
+        if (name.size() <= suffixSize || name.compare(name.size() - 4, 4, ".tmp") || name[name.size() - suffixSize] != '.')
+            return false;
+
+        return isHexRun(name, name.size() - suffixSize + 1, 16) && isCacheEntryName(name.substr(0, name.size() - suffixSize));
+    }
+
+    u64 readU64(const u8* pData) {
+        u64 ret = 0;
+        for (s32 i = 0; i < 8; i++)
+            ret |= (u64)pData[i] << (i * 8);
+        return ret;
+    }
+};
+
+JKRCompressionCache::JKRCompressionCache(const std::string &directory, u64 maxSize) {
+    mDirectory = directory;
+    mMaxSize = maxSize;
+
+    std::error_code ec;
+    ghc::filesystem::create_directories(mDirectory, ec);
+
+    for (const auto &entry : ghc::filesystem::directory_iterator(mDirectory, ec)) {
+        if (entry.is_regular_file(ec) && isCacheEntryName(entry.path().filename().string()))
+            mApproxSize += entry.file_size(ec);
+    }
+}
+
+JKRCompressionCache::Key JKRCompressionCache::makeKey(const u8 *pSrc, u32 srcSize) {
+    Key key;
+    u64 lo = 0x243F6A8885A308D3 ^ srcSize;
+    u64 hi = 0x13198A2E03707344 ^ ((u64)srcSize << 32);
+    u32 pos = 0;
+
+    for (; pos + 8 <= srcSize; pos += 8) {
+        u64 val = readU64(pSrc + pos);
+        lo = mixHash(lo, val);
+        hi = mixHash(hi, val ^ lo);
+    }
+
+    u64 rest = 0;
+    for (u32 i = 0; pos + i < srcSize; i++)
+        rest |= (u64)pSrc[pos + i] << (i * 8);
+
+    key.mHashLo = mixHash(lo, rest);
+    key.mHashHi = mixHash(hi, rest ^ key.mHashLo);
+    key.mSize = srcSize;
+    return key;
+}
+
+std::string JKRCompressionCache::getEntryPath(const Key &key, const std::string &encoder, s32 level) {
+    char name[96];
+    snprintf(name, sizeof(name), "%s-%016llx%016llx-%08x-%s-%d.bin", cCacheVersion,
+        (unsigned long long)key.mHashHi, (unsigned long long)key.mHashLo, (unsigned)key.mSize, encoder.c_str(), (int)level);
+    return (ghc::filesystem::path(mDirectory) / name).string();
+}
+
+u8* JKRCompressionCache::load(const u8 *pSrc, u32 srcSize, const std::string &encoder, s32 level, u32 *pDstSize) {
+    Key key = makeKey(pSrc, srcSize);
+    std::string entryPath = getEntryPath(key, encoder, level);
+    std::error_code ec;
+
+    // Read through a plain stream, the entry may be evicted by another process at any moment
+    std::ifstream stream(entryPath, std::ifstream::in | std::ifstream::binary);
+    if (!stream)
+        return nullptr;
+
+    stream.seekg(0, std::ios::end);
+    u32 fileSize = stream.tellg();
+    stream.seekg(0, std::ios::beg);
+
+    if (!stream || fileSize < 0x20)
+        return nullptr;
+
+    u8* pFile = new u8[fileSize];
+    stream.read((char*)pFile, fileSize);
+
+    // Entries are written whole and renamed into place, but a foreign or truncated file is still just a miss
+    if (!stream || memcmp(pFile, "JKCC", 4)) {
+        delete [] pFile;
+        return nullptr;
+    }
+    stream.close();
+
+    BinaryReader reader(pFile, fileSize, EndianSelect::Big);
+    reader.skip(4);
+    u32 entrySrcSize = reader.read<u32>();
+    u64 hashHi = reader.read<u64>();
+    u64 hashLo = reader.read<u64>();
+    u32 dstSize = reader.read<u32>();
+
+    if (entrySrcSize != srcSize || hashHi != key.mHashHi || hashLo != key.mHashLo || dstSize != fileSize - 0x20) {
+        delete [] pFile;
+        return nullptr;
+    }
+
+    u8* pDst = new u8[dstSize];
+    memcpy(pDst, pFile + 0x20, dstSize);
+    delete [] pFile;
+
+    // Touch the entry so eviction sees it as recently used
+    ghc::filesystem::last_write_time(entryPath, std::chrono::system_clock::now(), ec);
+
+    *pDstSize = dstSize;
+    return pDst;
+}
+
+void JKRCompressionCache::store(const u8 *pSrc, u32 srcSize, const std::string &encoder, s32 level, const u8 *pDst, u32 dstSize) {
+    Key key = makeKey(pSrc, srcSize);
+    std::string entryPath = getEntryPath(key, encoder, level);
+
+    std::random_device random;
+    char suffix[32];
+    snprintf(suffix, sizeof(suffix), ".%08x%08x.tmp", (unsigned)random(), (unsigned)random());
+    std::string tmpPath = entryPath + suffix;
+
+    {
+        BinaryWriter writer(tmpPath, EndianSelect::Big);
+        writer.writeString("JKCC");
+        writer.write<u32>(srcSize);
+        writer.write<u64>(key.mHashHi);
+        writer.write<u64>(key.mHashLo);
+        writer.write<u32>(dstSize);
+        writer.writePadding(0x0, 4);
+        writer.writeBytes(pDst, dstSize);
+    }
+
+    // Publishing with a rename means other processes only ever see complete entries
+    std::error_code ec;
+    ghc::filesystem::rename(tmpPath, entryPath, ec);
+    if (ec) {
+        ghc::filesystem::remove(tmpPath, ec);
+        return;
+    }
+
+    mApproxSize += dstSize + 0x20;
+    if (mApproxSize > mMaxSize)
+        evict();
+}
+
+void JKRCompressionCache::evict() {
+    struct Entry {
+        ghc::filesystem::file_time_type mTime;
+        u64 mSize;
+        ghc::filesystem::path mPath;
+    };
+
+    std::vector<Entry> entries;
+    std::error_code ec;
+    u64 totalSize = 0;
+    auto staleTime = std::chrono::system_clock::now() - std::chrono::hours(1);
+
+    for (const auto &entry : ghc::filesystem::directory_iterator(mDirectory, ec)) {
+        if (!entry.is_regular_file(ec))
+            continue;
+
+        Entry info = { entry.last_write_time(ec), entry.file_size(ec), entry.path() };
+        std::string name = info.mPath.filename().string();
+
+        // Leftovers from a process that died mid-store
+        if (isCacheTempName(name)) {
+            if (info.mTime < staleTime)
+                ghc::filesystem::remove(info.mPath, ec);
+            continue;
+        }
+
+        if (!isCacheEntryName(name))
+            continue;
+
+        totalSize += info.mSize;
+        entries.push_back(info);
+    }
+
+    std::sort(entries.begin(), entries.end(), [](const Entry &a, const Entry &b) { return a.mTime < b.mTime; });
+
+    // Evict down to 90% of the limit so every store doesn't trigger another scan
+    u64 target = mMaxSize - mMaxSize / 10;
+    for (const auto &entry : entries) {
+        if (totalSize <= target)
+            break;
+
+        // Another process may have removed it already, either way it no longer counts
+        ghc::filesystem::remove(entry.mPath, ec);
+        totalSize -= entry.mSize;
+    }
+
+    mApproxSize = totalSize;
+}
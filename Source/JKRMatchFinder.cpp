@@ -0,0 +1,166 @@
+#include "..\Include\JKRMatchFinder.h"
+#include <algorithm>
+
+#if defined(__x86_64__) || defined(_M_X64) || defined(__i386__) || defined(_M_IX86)
+#define MATCH_FINDER_X86
+#include <immintrin.h>
+#ifdef _MSC_VER
+#include <intrin.h>
+#define MATCH_FINDER_AVX2
+#else
+#define MATCH_FINDER_AVX2 __attribute__((target("avx2")))
+#endif
+#endif
+
+namespace {
+    const u32 cMatchHashBits = 15;
+
+    u32 getMatchLengthScalar(const u8 *pA, const u8 *pB, u32 maxLength) {
+        u32 length = 0;
+        while (length < maxLength && pA[length] == pB[length])
+            length++;
+        return length;
+    }
+
+#ifdef MATCH_FINDER_X86
+    u32 countTrailingZeros(u32 mask) {
+#ifdef _MSC_VER
+        unsigned long idx;
+        _BitScanForward(&idx, mask);
+        return idx;
+#else
+        return __builtin_ctz(mask);
+#endif
+    }
+
+    // Compares 16 bytes per step, the first clear bit of the equality mask is the first mismatch
+    u32 getMatchLengthSSE2(const u8 *pA, const u8 *pB, u32 maxLength) {
+        u32 length = 0;
+        for (; length + 16 <= maxLength; length += 16) {
+            __m128i a = _mm_loadu_si128((const __m128i*)(pA + length));
+            __m128i b = _mm_loadu_si128((const __m128i*)(pB + length));
+            u32 mask = ~_mm_movemask_epi8(_mm_cmpeq_epi8(a, b)) & 0xFFFF;
+
+            if (mask)
+                return length + countTrailingZeros(mask);
+        }
+
+        return length + getMatchLengthScalar(pA + length, pB + length, maxLength - length);
+    }
+
+    MATCH_FINDER_AVX2 u32 getMatchLengthAVX2(const u8 *pA, const u8 *pB, u32 maxLength) {
+        u32 length = 0;
+        for (; length + 32 <= maxLength; length += 32) {
+            __m256i a = _mm256_loadu_si256((const __m256i*)(pA + length));
+            __m256i b = _mm256_loadu_si256((const __m256i*)(pB + length));
+            u32 mask = ~(u32)_mm256_movemask_epi8(_mm256_cmpeq_epi8(a, b));
+
+            if (mask)
+                return length + countTrailingZeros(mask);
+        }
+
+        return length + getMatchLengthSSE2(pA + length, pB + length, maxLength - length);
+    }
+
+    bool hasAVX2() {
+#ifdef _MSC_VER
+        int info[4];
+        __cpuid(info, 0);
+        if (info[0] < 7)
+            return false;
+
+        // AVX2 also needs the OS to save the YMM registers
+        __cpuid(info, 1);
+        if (!(info[2] & (1 << 27)) || !(info[2] & (1 << 28)) || (_xgetbv(0) & 0x6) != 0x6)
+            return false;
+
+        __cpuidex(info, 7, 0);
+        return (info[1] & (1 << 5)) != 0;
+#else
+        __builtin_cpu_init();
+        return __builtin_cpu_supports("avx2");
+#endif
+    }
+#endif
+
+    typedef u32 (*MatchLengthFunc)(const u8 *, const u8 *, u32);
+
+    MatchLengthFunc selectMatchLength() {
+#ifdef MATCH_FINDER_X86
+        if (hasAVX2())
+            return getMatchLengthAVX2;
+        return getMatchLengthSSE2;
+#else
+        return getMatchLengthScalar;
+#endif
+    }
+
+    // Picked once at startup from what the CPU supports
+    const MatchLengthFunc cMatchLengthFunc = selectMatchLength();
+};
+
+JKRMatchFinder::JKRMatchFinder() {
+    mChainDepth = 32;
+    mNiceLength = cSZSMaxMatch;
+    mHead.resize(1 << cMatchHashBits);
+    mPrev.resize(cSZSWindowSize);
+}
+
+void JKRMatchFinder::reset(const u8 *pSrc, u32 size) {
+    mSrc = pSrc;
+    mSize = size;
+    std::fill(mHead.begin(), mHead.end(), -1);
+    std::fill(mPrev.begin(), mPrev.end(), -1);
+}
+
+u32 JKRMatchFinder::hash(u32 pos) {
+    u32 val = (mSrc[pos] << 16) | (mSrc[pos + 1] << 8) | mSrc[pos + 2];
+    return ((val * 0x9E3779B1) >> (32 - cMatchHashBits)) & ((1 << cMatchHashBits) - 1);
+}
+
+void JKRMatchFinder::insert(u32 pos) {
+    if (pos + cSZSMinMatch > mSize)
+        return;
+
+    u32 h = hash(pos);
+    mPrev[pos & (cSZSWindowSize - 1)] = mHead[h];
+    mHead[h] = pos;
+}
+
+u32 JKRMatchFinder::findMatch(u32 pos, u32 *pMatchPos) {
+    if (pos + cSZSMinMatch > mSize)
+        return 0;
+
+    u32 maxLength = std::min(cSZSMaxMatch, mSize - pos);
+    u32 niceLength = std::min(mNiceLength, maxLength);
+    u32 bestLength = 0;
+    s32 cand = mHead[hash(pos)];
+    s32 minPos = (s32)pos - (s32)cSZSWindowSize;
+
+    for (u32 depth = mChainDepth; cand >= 0 && cand >= minPos && depth > 0; depth--) {
+        // Cheap reject on the byte that would have to extend the current best
+        if (mSrc[cand + bestLength] == mSrc[pos + bestLength]) {
+            u32 length = getMatchLength(mSrc + cand, mSrc + pos, maxLength);
+
+            if (length > bestLength) {
+                bestLength = length;
+                *pMatchPos = cand;
+
+                if (length >= niceLength)
+                    break;
+            }
+        }
+
+        s32 next = mPrev[cand & (cSZSWindowSize - 1)];
+        // The ring slot has been reused by a newer position, the chain ends here
+        if (next >= cand)
+            break;
+        cand = next;
+    }
+
+    return bestLength >= cSZSMinMatch ? bestLength : 0;
+}
+
+u32 JKRMatchFinder::getMatchLength(const u8 *pA, const u8 *pB, u32 maxLength) {
+    return cMatchLengthFunc(pA, pB, maxLength);
+}
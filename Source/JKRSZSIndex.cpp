@@ -0,0 +1,313 @@
+#include "..\Include\JKRSZSIndex.h"
+#include "..\Include\JKRCompression.h"
+#include "..\Include\BinaryReaderAndWriter.h"
+#include <fstream>
+#include <thread>
+#include <atomic>
+
+namespace {
+    // Bump whenever the sidecar layout changes
+    const u32 cSZSIndexVersion = 2;
+
+    u32 readIndexU32(const u8 *pData) {
+        return (pData[0] << 24) | (pData[1] << 16) | (pData[2] << 8) | pData[3];
+    }
+};
+
+std::string JKRSZSIndex::getSidecarPath(const std::string &filePath) {
+    return filePath + ".idx";
+}
+
+// Covers every byte of the span, four at a time so checking doesn't slow decoding down noticeably
+u32 JKRSZSIndex::hashSpan(const u8 *pData, u32 size) {
+    u64 hash = 0x811C9DC5 ^ size;
+    u32 i = 0;
+    for (; i + 4 <= size; i += 4)
+        hash = (hash ^ readIndexU32(pData + i)) * 0x9E3779B97F4A7C15;
+    for (; i < size; i++)
+        hash = (hash ^ pData[i]) * 0x9E3779B97F4A7C15;
+    return hash ^ (hash >> 32);
+}
+
+// End of checkpoint span in the compressed stream, the last one runs to the end of the file
+u32 JKRSZSIndex::getSpanEnd(u32 checkpoint) {
+    return checkpoint + 1 < mCheckpoints.size() ? mCheckpoints[checkpoint + 1].mCompOffs : mCompSize;
+}
+
+// Walks the token stream once and drops a checkpoint on the first group header past every interval.
+// With the decompressed data at hand only the token lengths are parsed, otherwise the stream is
+// decoded into a 4 KB ring to recover the history.
+bool JKRSZSIndex::build(const u8 *pComp, u32 compSize, const u8 *pDecomp, u32 interval) {
+    if (compSize < 0x10 || memcmp(pComp, "Yaz0", 4))
+        return false;
+
+    mCompSize = compSize;
+    mDecompSize = readIndexU32(pComp + 4);
+    mCheckpoints.clear();
+
+    std::vector<u8> ring(pDecomp ? 0 : cSZSWindowSize);
+    const u32 mask = cSZSWindowSize - 1;
+    u32 src = 0x10;
+    u32 pos = 0;
+    u32 next = 0;
+
+    while (pos < mDecompSize) {
+        if (pos >= next) {
+            JKRSZSCheckpoint checkpoint;
+            u32 windowSize = std::min(pos, cSZSWindowSize);
+            checkpoint.mCompOffs = src;
+            checkpoint.mDecompOffs = pos;
+            checkpoint.mWindow.resize(windowSize);
+
+            for (u32 i = 0; i < windowSize; i++)
+                checkpoint.mWindow[i] = pDecomp ? pDecomp[pos - windowSize + i] : ring[(pos - windowSize + i) & mask];
+
+            mCheckpoints.push_back(std::move(checkpoint));
+            next = pos + std::max<u32>(interval, 1);
+        }
+
+        if (src >= compSize)
+            return false;
+
+        u8 flags = pComp[src++];
+        for (u32 bit = 0; bit < 8 && pos < mDecompSize; bit++, flags <<= 1) {
+            if (flags & 0x80) {
+                if (src >= compSize)
+                    return false;
+                if (!pDecomp)
+                    ring[pos & mask] = pComp[src];
+                src++;
+                pos++;
+                continue;
+            }
+
+            if (compSize - src < 2)
+                return false;
+
+            u32 dist = (((pComp[src] & 0xF) << 8) | pComp[src + 1]) + 1;
+            u32 count = pComp[src] >> 4;
+            src += 2;
+
+            if (count == 0) {
+                if (src >= compSize)
+                    return false;
+                count = pComp[src++] + 0x12;
+            }
+            else
+                count += 2;
+
+            if (dist > pos || count > mDecompSize - pos)
+                return false;
+
+            if (!pDecomp) {
+                for (u32 i = 0; i < count; i++)
+                    ring[(pos + i) & mask] = ring[(pos + i - dist) & mask];
+            }
+            pos += count;
+        }
+    }
+
+    // Spans are only known once the next checkpoint is
+    for (u32 i = 0; i < mCheckpoints.size(); i++)
+        mCheckpoints[i].mCheck = hashSpan(pComp + mCheckpoints[i].mCompOffs, getSpanEnd(i) - mCheckpoints[i].mCompOffs);
+    return true;
+}
+
+bool JKRSZSIndex::load(const std::string &filePath) {
+    if (!File::FileExists(filePath))
+        return false;
+
+    u32 size;
+    u8* pData = File::readAllBytes(filePath, &size);
+    u32 pos = 0x14;
+    bool valid = size >= 0x14 && !memcmp(pData, "JKZI", 4) && readIndexU32(pData + 4) == cSZSIndexVersion;
+
+    if (valid) {
+        mCompSize = readIndexU32(pData + 8);
+        mDecompSize = readIndexU32(pData + 12);
+        u32 count = readIndexU32(pData + 16);
+        mCheckpoints.clear();
+
+        for (u32 i = 0; i < count && valid; i++) {
+            if (size - pos < 0x10) {
+                valid = false;
+                break;
+            }
+
+            JKRSZSCheckpoint checkpoint;
+            checkpoint.mCompOffs = readIndexU32(pData + pos);
+            checkpoint.mDecompOffs = readIndexU32(pData + pos + 4);
+            checkpoint.mCheck = readIndexU32(pData + pos + 8);
+            u32 windowSize = readIndexU32(pData + pos + 12);
+            pos += 0x10;
+
+            valid = windowSize <= cSZSWindowSize && windowSize <= checkpoint.mDecompOffs && size - pos >= windowSize &&
+                checkpoint.mCompOffs < mCompSize && checkpoint.mDecompOffs < mDecompSize &&
+                (mCheckpoints.empty() || (checkpoint.mCompOffs > mCheckpoints.back().mCompOffs && checkpoint.mDecompOffs > mCheckpoints.back().mDecompOffs));
+
+            if (valid) {
+                checkpoint.mWindow.assign(pData + pos, pData + pos + windowSize);
+                pos += windowSize;
+                mCheckpoints.push_back(std::move(checkpoint));
+            }
+        }
+
+        // Decoding always needs a checkpoint at the very start
+        valid = valid && (mDecompSize == 0 || (!mCheckpoints.empty() && mCheckpoints[0].mDecompOffs == 0));
+    }
+
+    delete [] pData;
+    if (!valid)
+        mCheckpoints.clear();
+    return valid;
+}
+
+void JKRSZSIndex::save(const std::string &filePath) {
+    BinaryWriter writer(filePath, EndianSelect::Big);
+    writer.writeString("JKZI");
+    writer.write<u32>(cSZSIndexVersion);
+    writer.write<u32>(mCompSize);
+    writer.write<u32>(mDecompSize);
+    writer.write<u32>(mCheckpoints.size());
+
+    for (const auto &checkpoint : mCheckpoints) {
+        writer.write<u32>(checkpoint.mCompOffs);
+        writer.write<u32>(checkpoint.mDecompOffs);
+        writer.write<u32>(checkpoint.mCheck);
+        writer.write<u32>(checkpoint.mWindow.size());
+        writer.writeBytes(checkpoint.mWindow.data(), checkpoint.mWindow.size());
+    }
+}
+
+// Decodes checkpoints [first, last) into buffer, laid out as the first checkpoint's window followed by the span.
+// pSlice holds the compressed bytes from sliceOffs on, every span is checked against its hash before decoding.
+bool JKRSZSIndex::decodeSpan(const u8 *pSlice, u32 sliceOffs, u32 sliceSize, u32 first, u32 last, std::vector<u8> &buffer) {
+    const JKRSZSCheckpoint &start = mCheckpoints[first];
+    u32 endComp = getSpanEnd(last - 1);
+    u32 endDecomp = last < mCheckpoints.size() ? mCheckpoints[last].mDecompOffs : mDecompSize;
+
+    if (start.mCompOffs < sliceOffs || endComp - sliceOffs > sliceSize)
+        return false;
+
+    for (u32 i = first; i < last; i++) {
+        if (mCheckpoints[i].mCheck != hashSpan(pSlice + mCheckpoints[i].mCompOffs - sliceOffs, getSpanEnd(i) - mCheckpoints[i].mCompOffs))
+            return false;
+    }
+
+    u32 windowSize = start.mWindow.size();
+    buffer.resize(windowSize + endDecomp - start.mDecompOffs);
+    std::copy(start.mWindow.begin(), start.mWindow.end(), buffer.begin());
+
+    return JKRCompression::decodeSZSRange(pSlice + start.mCompOffs - sliceOffs, pSlice + endComp - sliceOffs, buffer.data() + windowSize, endDecomp - start.mDecompOffs, windowSize);
+}
+
+// Checkpoints [*pFirst, *pLast) are the ones the range needs
+bool JKRSZSIndex::findSpans(u32 offset, u32 size, u32 *pFirst, u32 *pLast) {
+    if (offset > mDecompSize || size > mDecompSize - offset || mCheckpoints.empty()) {
+        printf("Range is outside of the indexed stream!\n");
+        return false;
+    }
+
+    auto compare = [](u32 val, const JKRSZSCheckpoint &checkpoint) { return val < checkpoint.mDecompOffs; };
+    *pFirst = std::upper_bound(mCheckpoints.begin(), mCheckpoints.end(), offset, compare) - mCheckpoints.begin() - 1;
+    *pLast = std::upper_bound(mCheckpoints.begin(), mCheckpoints.end(), offset + size - (size != 0), compare) - mCheckpoints.begin();
+    return true;
+}
+
+// Decodes the range out of a slice of the compressed stream that starts at sliceOffs
+u8* JKRSZSIndex::decodeSlice(const u8 *pSlice, u32 sliceOffs, u32 sliceSize, u32 offset, u32 size) {
+    u32 first, last;
+    if (!findSpans(offset, size, &first, &last))
+        return nullptr;
+
+    std::vector<u8> buffer;
+    if (!decodeSpan(pSlice, sliceOffs, sliceSize, first, last, buffer)) {
+        printf("Index doesn't match the compressed data!\n");
+        return nullptr;
+    }
+
+    u8* dst = new u8[size];
+    memcpy(dst, buffer.data() + mCheckpoints[first].mWindow.size() + offset - mCheckpoints[first].mDecompOffs, size);
+    return dst;
+}
+
+// Returns size bytes of output starting at offset, decoding only from the nearest checkpoint before it
+u8* JKRSZSIndex::decodeRange(const u8 *pComp, u32 compSize, u32 offset, u32 size) {
+    if (compSize != mCompSize) {
+        printf("Index doesn't match the compressed data!\n");
+        return nullptr;
+    }
+    return decodeSlice(pComp, 0, compSize, offset, size);
+}
+
+// Same, but only the compressed spans the range needs are read from the file
+u8* JKRSZSIndex::decodeRange(const std::string &filePath, u32 offset, u32 size) {
+    std::ifstream stream(filePath, std::ifstream::in | std::ifstream::binary);
+    if (!stream) {
+        printf("Fatal error! Can't open %s\n", filePath.c_str());
+        return nullptr;
+    }
+
+    stream.seekg(0, std::ios::end);
+    u32 first, last;
+    if ((u64)stream.tellg() != mCompSize) {
+        printf("Index doesn't match the compressed data!\n");
+        return nullptr;
+    }
+    if (!findSpans(offset, size, &first, &last))
+        return nullptr;
+
+    u32 sliceOffs = mCheckpoints[first].mCompOffs;
+    std::vector<u8> slice(getSpanEnd(last - 1) - sliceOffs);
+    stream.seekg(sliceOffs, std::ios::beg);
+    stream.read((char*)slice.data(), slice.size());
+
+    if ((u32)stream.gcount() != slice.size()) {
+        printf("Index doesn't match the compressed data!\n");
+        return nullptr;
+    }
+    return decodeSlice(slice.data(), sliceOffs, slice.size(), offset, size);
+}
+
+// Decodes the whole stream with every span between two checkpoints on whichever thread is free
+u8* JKRSZSIndex::decodeParallel(const u8 *pComp, u32 compSize, u32 threadCount) {
+    if (threadCount == 0)
+        threadCount = std::max<u32>(1, std::thread::hardware_concurrency());
+
+    if (compSize != mCompSize) {
+        printf("Index doesn't match the compressed data!\n");
+        return nullptr;
+    }
+
+    u8* dst = new u8[mDecompSize];
+    u32 spanCount = mCheckpoints.size();
+    std::atomic<u32> nextSpan(0);
+    std::atomic<bool> failed(false);
+
+    auto worker = [&]() {
+        std::vector<u8> buffer;
+        for (u32 span = nextSpan++; span < spanCount && !failed; span = nextSpan++) {
+            if (!decodeSpan(pComp, 0, compSize, span, span + 1, buffer)) {
+                failed = true;
+                break;
+            }
+
+            u32 windowSize = mCheckpoints[span].mWindow.size();
+            memcpy(dst + mCheckpoints[span].mDecompOffs, buffer.data() + windowSize, buffer.size() - windowSize);
+        }
+    };
+
+    std::vector<std::thread> threads;
+    for (u32 i = 1; i < std::min(threadCount, spanCount); i++)
+        threads.emplace_back(worker);
+    worker();
+    for (auto &thread : threads)
+        thread.join();
+
+    if (failed || (spanCount == 0 && mDecompSize)) {
+        printf("Index doesn't match the compressed data!\n");
+        delete [] dst;
+        return nullptr;
+    }
+    return dst;
+}
@@ -0,0 +1,197 @@
+#include "..\Include\JKRSZSStream.h"
+#include <algorithm>
+
+JKRSZSDecoder::JKRSZSDecoder() {
+    reset();
+}
+
+void JKRSZSDecoder::reset() {
+    mHeaderSize = 0;
+    mDecompSize = 0;
+    mOutPos = 0;
+    mFlags = 0;
+    mFlagBits = 0;
+    mTokenSize = 0;
+    mCopyDist = 0;
+    mCopyLeft = 0;
+    mFailed = false;
+}
+
+// Decodes as much as the given input and output allow. *pSrcUsed and *pDstWritten report the progress,
+// every consumed byte is remembered so the next call continues exactly where this one stopped.
+JKRStreamStatus JKRSZSDecoder::decode(const u8 *pSrc, u32 srcSize, u32 *pSrcUsed, u8 *pDst, u32 dstCapacity, u32 *pDstWritten) {
+    const u8* src = pSrc;
+    const u8* srcEnd = pSrc + srcSize;
+    u8* dst = pDst;
+    u8* dstEnd = pDst + dstCapacity;
+    JKRStreamStatus status = JKRStreamStatus_DONE;
+
+    while (true) {
+        if (mFailed) {
+            status = JKRStreamStatus_ERROR;
+            break;
+        }
+
+        if (mHeaderSize < 0x10) {
+            u32 count = std::min<u32>(0x10 - mHeaderSize, srcEnd - src);
+            memcpy(mHeader + mHeaderSize, src, count);
+            mHeaderSize += count;
+            src += count;
+
+            if (mHeaderSize < 0x10) {
+                status = JKRStreamStatus_NEED_INPUT;
+                break;
+            }
+
+            if (memcmp(mHeader, "Yaz0", 4)) {
+                mFailed = true;
+                continue;
+            }
+            mDecompSize = (mHeader[4] << 24) | (mHeader[5] << 16) | (mHeader[6] << 8) | mHeader[7];
+        }
+
+        // Finish a back-reference that an earlier call ran out of output space for
+        if (mCopyLeft) {
+            u32 count = std::min<u32>(mCopyLeft, dstEnd - dst);
+            for (u32 i = 0; i < count; i++) {
+                u8 val = mWindow[(mOutPos - mCopyDist) & (cSZSWindowSize - 1)];
+                mWindow[mOutPos++ & (cSZSWindowSize - 1)] = val;
+                *dst++ = val;
+            }
+            mCopyLeft -= count;
+
+            if (mCopyLeft) {
+                status = JKRStreamStatus_NEED_OUTPUT;
+                break;
+            }
+        }
+
+        if (mOutPos == mDecompSize) {
+            status = JKRStreamStatus_DONE;
+            break;
+        }
+
+        if (mFlagBits == 0) {
+            if (src == srcEnd) {
+                status = JKRStreamStatus_NEED_INPUT;
+                break;
+            }
+            mFlags = *src++;
+            mFlagBits = 8;
+        }
+
+        if (mFlags & 0x80) {
+            if (dst == dstEnd) {
+                status = JKRStreamStatus_NEED_OUTPUT;
+                break;
+            }
+            if (src == srcEnd) {
+                status = JKRStreamStatus_NEED_INPUT;
+                break;
+            }
+
+            u8 val = *src++;
+            mWindow[mOutPos++ & (cSZSWindowSize - 1)] = val;
+            *dst++ = val;
+        }
+        else {
+            // A token may be split across input chunks, collect it first
+            while (src < srcEnd && (mTokenSize < 2 || (mTokenSize == 2 && (mToken[0] >> 4) == 0)))
+                mToken[mTokenSize++] = *src++;
+
+            if (mTokenSize < 2 || (mTokenSize == 2 && (mToken[0] >> 4) == 0)) {
+                status = JKRStreamStatus_NEED_INPUT;
+                break;
+            }
+
+            mCopyDist = (((mToken[0] & 0xF) << 8) | mToken[1]) + 1;
+            mCopyLeft = (mToken[0] >> 4) ? (mToken[0] >> 4) + 2 : mToken[2] + 0x12;
+            mTokenSize = 0;
+
+            if (mCopyDist > mOutPos || mCopyLeft > mDecompSize - mOutPos) {
+                mFailed = true;
+                continue;
+            }
+        }
+
+        mFlags <<= 1;
+        mFlagBits--;
+    }
+
+    *pSrcUsed = src - pSrc;
+    *pDstWritten = dst - pDst;
+    return status;
+}
+
+JKRSZSEncoder::JKRSZSEncoder(u32 decompSize, s32 level, u32 blockSize, JKRCompressionContext *pContext) : mWriter(nullptr) {
+    mLevel = level;
+    if (pContext)
+        mContext.copySettings(*pContext);
+    mBlockSize = std::max<u32>(blockSize, cSZSWindowSize);
+
+    // Room for a whole block of literals plus the group left open by the previous one
+    mScratch.resize(mBlockSize + mBlockSize / 8 + 0x20);
+    mWriter.mDst = mScratch.data();
+
+    mOutput.resize(0x10);
+    memcpy(mOutput.data(), "Yaz0", 4);
+    patchHeader(mOutput.data(), decompSize);
+}
+
+void JKRSZSEncoder::patchHeader(u8 *pHeader, u32 decompSize) {
+    pHeader[4] = (decompSize >> 24) & 0xFF;
+    pHeader[5] = (decompSize >> 16) & 0xFF;
+    pHeader[6] = (decompSize >> 8) & 0xFF;
+    pHeader[7] = decompSize & 0xFF;
+}
+
+void JKRSZSEncoder::write(const u8 *pSrc, u32 size) {
+    mTotalIn += size;
+
+    while (size) {
+        u32 count = std::min<u32>(size, mHistorySize + mBlockSize - mInput.size());
+        mInput.insert(mInput.end(), pSrc, pSrc + count);
+        pSrc += count;
+        size -= count;
+
+        if (mInput.size() == mHistorySize + mBlockSize)
+            encodeBlock(mBlockSize);
+    }
+}
+
+void JKRSZSEncoder::finish() {
+    if (mFinished)
+        return;
+
+    if (mInput.size() > mHistorySize)
+        encodeBlock(mInput.size() - mHistorySize);
+
+    // The last group may be partial, it's final all the same
+    mOutput.insert(mOutput.end(), mScratch.data(), mScratch.data() + mWriter.mPos);
+    mWriter.mPos = 0;
+    mFinished = true;
+}
+
+u32 JKRSZSEncoder::read(u8 *pDst, u32 capacity) {
+    u32 count = std::min(capacity, getPendingSize());
+    memcpy(pDst, mOutput.data() + mOutputPos, count);
+    mOutputPos += count;
+
+    if (mOutputPos == mOutput.size()) {
+        mOutput.clear();
+        mOutputPos = 0;
+    }
+    return count;
+}
+
+void JKRSZSEncoder::encodeBlock(u32 blockSize) {
+    JKRCompression::encodeSZSBlock(mInput.data(), mHistorySize, mHistorySize + blockSize, mLevel, mWriter, mContext);
+
+    mOutput.insert(mOutput.end(), mScratch.data(), mScratch.data() + mWriter.getFinishedSize());
+    mWriter.dropFinished();
+
+    // Keep the window the next block's back-references can reach
+    u32 keep = std::min<u32>(mInput.size(), cSZSWindowSize);
+    mInput.erase(mInput.begin(), mInput.end() - keep);
+    mHistorySize = keep;
+}
@@ -0,0 +1,171 @@
+#include "..\Include\JKRSuffixMatchFinder.h"
+#include <algorithm>
+
+JKRSuffixMatchFinder::JKRSuffixMatchFinder() {
+    mBlockSize = 0x10000;
+    mMaxSteps = 0x1000;
+}
+
+void JKRSuffixMatchFinder::reset(const u8 *pSrc, u32 size) {
+    mSrc = pSrc;
+    mSize = size;
+    mBlockStart = 0;
+    mBlockEnd = 0;
+}
+
+u32 JKRSuffixMatchFinder::findMatch(u32 pos, u32 *pMatchPos) {
+    if (pos + cSZSMinMatch > mSize)
+        return 0;
+
+    if (pos < mBlockStart || pos >= mBlockEnd)
+        buildBlock(pos);
+
+    u32 length = mLengths[pos - mBlockStart];
+    if (length)
+        *pMatchPos = pos - mBacks[pos - mBlockStart];
+    return length;
+}
+
+// Prefix doubling with counting sorts, ranks of suffix pairs are refined until they're all unique
+void JKRSuffixMatchFinder::buildSuffixArray(u32 length) {
+    const u8* text = mSrc + mTextStart;
+    s32 n = length;
+    mSuffixes.resize(n);
+    mRanks.resize(n);
+    mScratch.resize(n);
+    mCounts.assign(std::max<s32>(n, 0x100) + 1, 0);
+
+    for (s32 i = 0; i < n; i++)
+        mCounts[text[i] + 1]++;
+    for (s32 i = 1; i <= 0x100; i++)
+        mCounts[i] += mCounts[i - 1];
+    for (s32 i = 0; i < n; i++)
+        mSuffixes[mCounts[text[i]]++] = i;
+    for (s32 i = 0; i < n; i++)
+        mRanks[i] = text[i];
+
+    for (s32 k = 1; ; k <<= 1) {
+        // Order by the second half first: suffixes without one, then the others in current order
+        s32 p = 0;
+        for (s32 i = n - k; i < n; i++)
+            mScratch[p++] = i;
+        for (s32 i = 0; i < n; i++) {
+            if (mSuffixes[i] >= k)
+                mScratch[p++] = mSuffixes[i] - k;
+        }
+
+        // A stable counting sort on the first half finishes the pair order
+        s32 rankCount = std::max<s32>(n, 0x100);
+        std::fill(mCounts.begin(), mCounts.begin() + rankCount + 1, 0);
+        for (s32 i = 0; i < n; i++)
+            mCounts[mRanks[i] + 1]++;
+        for (s32 i = 1; i <= rankCount; i++)
+            mCounts[i] += mCounts[i - 1];
+        for (s32 i = 0; i < n; i++)
+            mSuffixes[mCounts[mRanks[mScratch[i]]]++] = mScratch[i];
+
+        mScratch[mSuffixes[0]] = 0;
+        for (s32 i = 1; i < n; i++) {
+            s32 a = mSuffixes[i - 1];
+            s32 b = mSuffixes[i];
+            bool same = mRanks[a] == mRanks[b] && (a + k < n ? mRanks[a + k] : -1) == (b + k < n ? mRanks[b + k] : -1);
+            mScratch[b] = mScratch[a] + !same;
+        }
+        std::swap(mRanks, mScratch);
+
+        if (mRanks[mSuffixes[n - 1]] == n - 1)
+            break;
+    }
+}
+
+// Kasai's algorithm, mLCP[i] is the common prefix of the suffixes at i - 1 and i
+void JKRSuffixMatchFinder::buildLCP(u32 length) {
+    const u8* text = mSrc + mTextStart;
+    s32 n = length;
+    mLCP.assign(n, 0);
+
+    s32 h = 0;
+    for (s32 i = 0; i < n; i++) {
+        if (mRanks[i] == 0) {
+            h = 0;
+            continue;
+        }
+
+        s32 j = mSuffixes[mRanks[i] - 1];
+        while (i + h < n && j + h < n && text[i + h] == text[j + h])
+            h++;
+        mLCP[mRanks[i]] = h;
+
+        if (h)
+            h--;
+    }
+}
+
+void JKRSuffixMatchFinder::buildBlock(u32 pos) {
+    mBlockStart = pos;
+    mBlockEnd = std::min(mSize, pos + mBlockSize);
+    mTextStart = pos > cSZSWindowSize ? pos - cSZSWindowSize : 0;
+
+    // The text runs a maximum match length past the block so the prefixes near its end aren't cut short
+    u32 textEnd = std::min(mSize, mBlockEnd + cSZSMaxMatch);
+    u32 length = textEnd - mTextStart;
+    buildSuffixArray(length);
+    buildLCP(length);
+
+    mLengths.assign(mBlockEnd - mBlockStart, 0);
+    mBacks.assign(mBlockEnd - mBlockStart, 0);
+
+    for (u32 p = mBlockStart; p < mBlockEnd; p++) {
+        s32 cur = p - mTextStart;
+        s32 minPos = cur - (s32)cSZSWindowSize;
+        s32 rank = mRanks[cur];
+        s32 bestLength = 0;
+        s32 bestPos = 0;
+
+        // The common prefix only shrinks moving away in either direction, so the nearest earlier
+        // suffix within the window is the best one on its side. Both sides are walked in step and
+        // a side stops as soon as it can no longer beat what the other one found.
+        s32 up = rank;
+        s32 down = rank + 1;
+        s32 upCommon = cSZSMaxMatch;
+        s32 downCommon = cSZSMaxMatch;
+
+        for (u32 steps = 0; steps < mMaxSteps && (up > 0 || down < (s32)length); steps++) {
+            if (up > 0) {
+                upCommon = std::min(upCommon, mLCP[up]);
+                s32 cand = mSuffixes[up - 1];
+
+                if (upCommon <= bestLength || upCommon < (s32)cSZSMinMatch)
+                    up = 0;
+                else if (cand < cur && cand >= minPos) {
+                    bestLength = upCommon;
+                    bestPos = cand;
+                    up = 0;
+                }
+                else
+                    up--;
+            }
+
+            if (down < (s32)length) {
+                downCommon = std::min(downCommon, mLCP[down]);
+                s32 cand = mSuffixes[down];
+
+                if (downCommon <= bestLength || downCommon < (s32)cSZSMinMatch)
+                    down = length;
+                else if (cand < cur && cand >= minPos) {
+                    bestLength = downCommon;
+                    bestPos = cand;
+                    down = length;
+                }
+                else
+                    down++;
+            }
+        }
+
+        bestLength = std::min<s32>(bestLength, mSize - p);
+        if (bestLength >= (s32)cSZSMinMatch) {
+            mLengths[p - mBlockStart] = bestLength;
+            mBacks[p - mBlockStart] = cur - bestPos;
+        }
+    }
+}
@@ -1,31 +1,227 @@
 #include "BinaryReaderAndWriter.cpp"
 #include "JKRArchive.cpp"
 #include "JKRCompression.cpp"
+#include "JKRCompressionCache.cpp"
+#include "JKRMatchFinder.cpp"
+#include "JKRSZSStream.cpp"
+#include "JKRSZSIndex.cpp"
+#include "JKRSuffixMatchFinder.cpp"
+#include "JKRArchiveView.cpp"
 #include "Util.cpp"
 #include "..\Include\filesystem.hpp"
+#include <chrono>
 
 
 void printHelp() {
     printf("usage: JKRArchiveTools.exe [-OPTIONS]\n");
     printf("<Required>\n");
-    printf("-u/--unpack [*.arc] # unpacks the given archive\n");
+    printf("-u/--unpack [*.arc] # unpacks the given archive, an szs with an index (*.idx) next to it decodes on -j threads\n");
+    printf("--decompress        # (optional) with -u, decompresses szs/szp compressed files on -j threads\n");
     printf("-p/--pack [*]       # packs the given folder into an archive\n");
+    printf("-l/--list [*.arc]   # lists the size, attributes and path of every entry in the archive\n");
+    printf("-r/--replace [*.arc] [path] [file] # replaces a single file inside an uncompressed archive\n");
+    printf("--rebuild [*.arc] [out] # decompresses every entry on -j threads and saves the archive again at -c\n");
+    printf("--keep-compressed   # (optional) keeps the original compressed form, --rebuild writes it back and -u --decompress next to each file (*.szs/*.szp)\n");
     printf("\n<Packing options>\n");
     printf("-o/--out [*.arc]    # (optional) the ouput file name\n");
     printf("-szs                # compresses the output archive with szs compression\n");
     printf("-szp                # compresses the output archive with szp compression\n");
-    printf("-f/--fast           # increases compression speed at the expense of file size\n");
+    printf("-c [0-9]            # compression level, 0 = store only, 9 = smallest output (default 6)\n");
+    printf("-f/--fast           # same as -c 2, increases compression speed at the expense of file size\n");
+    printf("-best               # same as -c 9, smallest possible szs output at the expense of compression speed\n");
+    printf("-j [N]              # number of compression threads, default is one per core, 1 streams szs to the file\n");
+    printf("--finder [sa/hc]    # match finder of -c 9, suffix array (default) or hash chains\n");
+    printf("--time-budget [s]   # compresses the output archive at rising levels until the time is up, keeps the smallest\n");
+    printf("--effort [1-5]      # same, but tries a fixed number of levels so the output doesn't depend on the machine\n");
+    printf("--match-penalty [N] # extra cost in bits per match, trades some size for faster decoding (default 0)\n");
     printf("-Os                 # attempts to decrease archive size by removing duplicate strings\n");
+    printf("--cache [dir]       # reuses compressed data stored in the given cache folder\n");
+    printf("--cache-size [MB]   # (optional) size limit of the cache folder, default 1024\n");
+    printf("-idx                # writes a random-access index next to the szs output (*.idx)\n");
     printf("<File attributes>\n");
     printf("MRAM                # (default) preload file to main RAM\n");
     printf("ARAM                # (Gamecube only) preload file to auxiliary RAM\n");
     printf("DVD                 # load file from DVD\n");
     printf("<Other>\n");
+    printf("--build-index [*]   # scans an existing szs file and writes its random-access index (*.idx)\n");
+    printf("--read-range [*] [offset] [size] [out] # decodes only the given part of an indexed szs file\n");
+    printf("-b/--bench [*]      # measures szs size and speed of every level on the given file and checks each encoder round trips, -c picks a single level\n");
+    printf("--read-speed [MB/s] # (optional) with -b, also estimates the load time as reading plus decoding\n");
+    printf("--self-check        # builds an archive in memory, saves and reloads it and checks every file survived\n");
     printf("-h/--help           # show usage\n");
 }
 
-int main(int argc, char* argv[]) {  
+double getSeconds() {
+    return std::chrono::duration<double>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+JKRMatchFinderType getFinderType(const char *pName) {
+    if (!strcasecmp(pName, "hc"))
+        return JKRMatchFinderType_HASH_CHAIN;
+    if (!strcasecmp(pName, "sa"))
+        return JKRMatchFinderType_SUFFIX_ARRAY;
+
+    printf("Unknown match finder! Expected sa or hc\n");
+    exit(1);
+}
+
+// Segment size of the round trips below, small enough that most inputs are split and the seams get tested
+const u32 cVerifySegmentSize = 0x10000;
+
+// Runs the level through the multithreaded, streaming and Yay0 encoders, each output has to decode back to the
+// source and the streaming one has to equal the multithreaded one
+bool verifyLevel(u8 *src, u32 srcSize, s32 level, JKRCompressionContext &context) {
+    bool passed = true;
+    auto check = [&](const char *pName, const u8 *pDst, u32 dstSize, bool isSZP) {
+        u32 size;
+        u8* decoded = isSZP ? JKRCompression::tryDecodeSZP(pDst, dstSize, &size) : JKRCompression::tryDecodeSZS(pDst, dstSize, &size);
+        if (!decoded || size != srcSize || memcmp(decoded, src, srcSize)) {
+            printf("level %d: %s output doesn't decode back to the source!\n", (int)level, pName);
+            passed = false;
+        }
+        delete [] decoded;
+    };
+
+    u32 parallelSize;
+    const u8* parallel = JKRCompression::encodeSZSParallel(src, srcSize, &parallelSize, level, 4, cVerifySegmentSize, &context);
+    check("multithreaded szs", parallel, parallelSize, false);
+
+    // Written in odd sized pieces so the encoder has to buffer across block boundaries
+    std::vector<u8> stream;
+    JKRSZSEncoder encoder(srcSize, level, cVerifySegmentSize, &context);
+    u8 chunk[0x1000];
+    for (u32 pos = 0; pos < srcSize; pos += 0x3001) {
+        encoder.write(src + pos, std::min<u32>(srcSize - pos, 0x3001));
+        while (u32 size = encoder.read(chunk, sizeof(chunk)))
+            stream.insert(stream.end(), chunk, chunk + size);
+    }
+    encoder.finish();
+    while (u32 size = encoder.read(chunk, sizeof(chunk)))
+        stream.insert(stream.end(), chunk, chunk + size);
+
+    check("streaming szs", stream.data(), stream.size(), false);
+    if (stream.size() != parallelSize || memcmp(stream.data(), parallel, parallelSize)) {
+        printf("level %d: streaming szs output differs from the multithreaded one!\n", (int)level);
+        passed = false;
+    }
+    delete [] parallel;
+
+    u32 szpSize;
+    const u8* szp = JKRCompression::encodeSZP(src, srcSize, &szpSize, level, 4, cVerifySegmentSize, &context);
+    check("szp", szp, szpSize, true);
+    delete [] szp;
+    return passed;
+}
+
+// Compresses the file once per level, then decodes it repeatedly to get a stable decode throughput.
+// With a read speed the load time is estimated too, a smaller stream isn't always the faster one to load.
+// Every level is also checked to round trip through each encoder, false if any of them didn't.
+bool runBenchmark(const std::string &filePath, s32 minLevel, s32 maxLevel, JKRCompressionContext &context, double readSpeed) {
+    u32 srcSize;
+    u8* src = File::readAllBytes(filePath, &srcSize);
+    double megaBytes = srcSize / (1024.0 * 1024.0);
+    bool passed = true;
+
+    for (s32 level = minLevel; level <= maxLevel; level++) {
+        u32 dstSize;
+        double start = getSeconds();
+        const u8* dst = JKRCompression::encodeSZS(src, srcSize, &dstSize, level, false, &context);
+        double encodeTime = getSeconds() - start;
+
+        u32 rounds = 0;
+        bool matches = true;
+        start = getSeconds();
+        do {
+            u8* decoded = JKRCompression::decodeSZS(dst, dstSize);
+            matches &= decoded && !memcmp(decoded, src, srcSize);
+            delete [] decoded;
+            rounds++;
+        } while (getSeconds() - start < 0.5);
+        double decodeTime = (getSeconds() - start) / rounds;
+
+        printf("level %d: %u -> %u (%.2f%%)  compress %.1f MB/s  decompress %.1f MB/s", (int)level, (unsigned)srcSize, (unsigned)dstSize,
+            dstSize * 100.0 / std::max<u32>(srcSize, 1), megaBytes / encodeTime, megaBytes / decodeTime);
+        if (readSpeed > 0)
+            printf("  load %.2f ms", (dstSize / (1024.0 * 1024.0) / readSpeed + decodeTime) * 1000.0);
+        printf("%s\n", matches ? "" : "  MISMATCH");
+        delete [] dst;
+
+        passed &= matches && verifyLevel(src, srcSize, level, context);
+    }
+
+    delete [] src;
+    return passed;
+}
+
+// The file is opened and sniffed once, Yaz0 is decoded as it's read so the compressed image is never
+// held in full, or on threadCount threads when it has an index. The archive takes the image over without a copy.
+JKRArchive* loadArchive(const std::string &filePath, u32 threadCount = 0) {
     u32 bufferSize;
+    JKRCompressionType compType;
+    std::shared_ptr<u8[]> file(JKRCompression::decodeFile(filePath, &bufferSize, &compType, threadCount));
+    return new JKRArchive(file, bufferSize);
+}
+
+// Builds an archive through addFile alone, saves it to memory and reads it back, every payload has to come out
+// unchanged. Covers nested folder creation, each preload type including none, compression and replacing a file.
+bool runSelfCheck() {
+    std::vector<u8> text(0x3000);
+    std::vector<u8> bytes(0x1000);
+    static u8 raw[0x200];
+    for (u32 i = 0; i < text.size(); i++)
+        text[i] = "JKRArchive "[i % 11];
+    for (u32 i = 0; i < bytes.size(); i++)
+        bytes[i] = i * 7;
+    for (u32 i = 0; i < sizeof(raw); i++)
+        raw[i] = i ^ 0x5A;
+
+    std::map<std::string, std::vector<u8>> expected = {
+        { "plain.bin", text },
+        { "a/b/dvd.bin", bytes },
+        { "a/aram.bin", std::vector<u8>(raw, raw + sizeof(raw)) },
+        { "a/b/szs.bin", text },
+        { "a/b/empty.bin", std::vector<u8>() },
+    };
+
+    JKRArchive archive;
+    archive.addFile("plain.bin", std::vector<u8>(bytes), JKRFileAttr_FILE);
+    archive.addFile("PLAIN.BIN", std::vector<u8>(text), JKRFileAttr_FILE);
+    archive.addFile("a/b/dvd.bin", std::vector<u8>(bytes), (JKRFileAttr)(JKRFileAttr_FILE | JKRFileAttr_LOAD_FROM_DVD));
+    archive.addFile("a\\aram.bin", raw, sizeof(raw), (JKRFileAttr)(JKRFileAttr_FILE | JKRFileAttr_LOAD_TO_ARAM));
+    archive.addFile("/a/b/szs.bin", std::vector<u8>(text), JKRFileAttr_FILE_AND_COMPRESSION);
+    archive.addFile("a/b/empty.bin", std::vector<u8>(), JKRFileAttr_FILE);
+
+    std::vector<u8> image = archive.saveToMemory(false);
+    JKRArchive loaded(image.data(), image.size());
+    loaded.decompressEntries(1);
+
+    bool passed = true;
+    u32 fileCount = 0;
+    loaded.walk([&](const std::string &path, const std::shared_ptr<JKRDirectory> &dir) {
+        if (!dir->isFile())
+            return true;
+
+        fileCount++;
+        auto iter = expected.find(path);
+        if (iter == expected.end() || iter->second.size() != dir->mNode.mDataSize ||
+            (dir->mNode.mDataSize && memcmp(iter->second.data(), dir->mData.get(), dir->mNode.mDataSize))) {
+            printf("Fatal error! Self-check failed on %s\n", path.c_str());
+            passed = false;
+        }
+        return true;
+    });
+
+    if (fileCount != expected.size()) {
+        printf("Fatal error! Self-check expected %u files, found %u\n", (unsigned)expected.size(), (unsigned)fileCount);
+        passed = false;
+    }
+
+    if (passed)
+        printf("Self-check passed!\n");
+    return passed;
+}
+
+int main(int argc, char* argv[]) {  
     bool fastComp = false;
 
     if (argc == 1) {
@@ -46,17 +242,191 @@ int main(int argc, char* argv[]) {
                 return 1;
             }
             
+            bool decompress = false;
+            bool keepCompressed = false;
+            u32 threadCount = 0;
+            for (s32 y = 1; y < argc; y++) {
+                if (!strcasecmp(argv[y], "--decompress"))
+                    decompress = true;
+
+                if (!strcasecmp(argv[y], "--keep-compressed"))
+                    keepCompressed = true;
+
+                if (!strcasecmp(argv[y], "-j") && y + 1 < argc)
+                    threadCount = atoi(argv[y + 1]);
+            }
+
             printf("Checking for compression!\n");
-            u8* pData = JKRCompression::decode(filePath, &bufferSize);
-            JKRArchive* archive;
+            JKRArchive* archive = loadArchive(filePath, threadCount);
 
-            if (!pData)
-                archive = new JKRArchive(filePath);       
-            else 
-                archive = new JKRArchive(pData, bufferSize);
+            if (decompress)
+                archive->decompressEntries(threadCount, keepCompressed);
             archive->unpack(ghc::filesystem::current_path().string());
             delete archive;
-            delete pData;
+        }
+        else if ((!strcasecmp(argv[i], "-l") || !strcasecmp(argv[i], "--list")) && i + 1 < argc) {
+            std::string filePath = argv[i + 1];
+
+            if (!File::FileExists(filePath)) {
+                printf("File isn't exist!\n");
+                return 1;
+            }
+
+            JKRArchive* archive = loadArchive(filePath);
+            archive->walk([](const std::string &path, const std::shared_ptr<JKRDirectory> &dir) {
+                if (dir->isDirectory())
+                    printf("%10s  %02X  %s/\n", "", dir->mAttr, path.c_str());
+                else
+                    printf("%10u  %02X  %s\n", (unsigned)dir->mNode.mDataSize, dir->mAttr, path.c_str());
+                return true;
+            });
+
+            delete archive;
+            i++;
+        }
+        else if (!strcasecmp(argv[i], "--self-check")) {
+            if (!runSelfCheck())
+                return 1;
+        }
+        else if (!strcasecmp(argv[i], "-r") || !strcasecmp(argv[i], "--replace")) {
+            if (i + 3 >= argc) {
+                printHelp();
+                return 1;
+            }
+
+            std::string archivePath = argv[i + 1];
+            std::string entryPath = argv[i + 2];
+            std::string filePath = argv[i + 3];
+
+            if (!File::FileExists(archivePath) || !File::FileExists(filePath)) {
+                printf("File isn't exist!\n");
+                return 1;
+            }
+
+            printf("Replacing %s!\n", entryPath.c_str());
+            u32 size;
+            u8* pData = File::readAllBytes(filePath, &size);
+            bool replaced = JKRArchivePatch::replaceFile(archivePath, entryPath, pData, size);
+            delete [] pData;
+
+            if (!replaced)
+                return 1;
+            i += 3;
+        }
+        else if (!strcasecmp(argv[i], "--rebuild") && i + 2 < argc) {
+            std::string filePath = argv[i + 1];
+            std::string outputPath = argv[i + 2];
+
+            if (!File::FileExists(filePath)) {
+                printf("File isn't exist!\n");
+                return 1;
+            }
+
+            JKRArchive* archive = loadArchive(filePath);
+
+            bool keepCompressed = false;
+            u32 threadCount = 0;
+            for (s32 y = 1; y < argc; y++) {
+                if (!strcasecmp(argv[y], "--keep-compressed"))
+                    keepCompressed = true;
+
+                if (!strcasecmp(argv[y], "-j") && y + 1 < argc)
+                    threadCount = atoi(argv[y + 1]);
+
+                if (!strcasecmp(argv[y], "-c") && y + 1 < argc)
+                    archive->mCompressionLevel = atoi(argv[y + 1]);
+
+                if (!strcasecmp(argv[y], "--finder") && y + 1 < argc)
+                    archive->mCompressionContext->mFinderType = getFinderType(argv[y + 1]);
+
+                if (!strcasecmp(argv[y], "--match-penalty") && y + 1 < argc)
+                    archive->mCompressionContext->mMatchPenalty = atoi(argv[y + 1]);
+            }
+
+            archive->decompressEntries(threadCount, keepCompressed);
+            archive->save(outputPath, false);
+            delete archive;
+            i += 2;
+        }
+        else if (!strcasecmp(argv[i], "--read-range") && i + 4 < argc) {
+            std::string filePath = argv[i + 1];
+            u32 offset = strtoul(argv[i + 2], nullptr, 0);
+            u32 size = strtoul(argv[i + 3], nullptr, 0);
+            std::string outputPath = argv[i + 4];
+
+            if (!File::FileExists(filePath)) {
+                printf("File isn't exist!\n");
+                return 1;
+            }
+
+            JKRSZSIndex index;
+            if (!index.load(JKRSZSIndex::getSidecarPath(filePath))) {
+                printf("Fatal error! %s has no valid index, create one with --build-index\n", filePath.c_str());
+                return 1;
+            }
+
+            u8* pData = index.decodeRange(filePath, offset, size);
+            if (!pData)
+                return 1;
+
+            File::writeAllBytes(outputPath, pData, size);
+            delete [] pData;
+            i += 4;
+        }
+        else if (!strcasecmp(argv[i], "--build-index") && i + 1 < argc) {
+            std::string filePath = argv[i + 1];
+
+            if (!File::FileExists(filePath)) {
+                printf("File isn't exist!\n");
+                return 1;
+            }
+
+            u32 size;
+            u8* pData = File::readAllBytes(filePath, &size);
+            JKRSZSIndex index;
+            bool built = index.build(pData, size);
+            delete [] pData;
+
+            if (!built) {
+                printf("Fatal error! Not a valid Yaz0 file\n");
+                return 1;
+            }
+
+            index.save(JKRSZSIndex::getSidecarPath(filePath));
+            printf("Indexed %u checkpoints!\n", (unsigned)index.mCheckpoints.size());
+            i++;
+        }
+        else if ((!strcasecmp(argv[i], "-b") || !strcasecmp(argv[i], "--bench")) && i + 1 < argc) {
+            std::string filePath = argv[i + 1];
+
+            if (!File::FileExists(filePath)) {
+                printf("File isn't exist!\n");
+                return 1;
+            }
+
+            s32 minLevel = JKRCompressionLevel_STORE + 1;
+            s32 maxLevel = JKRCompressionLevel_MAX;
+            JKRCompressionContext context;
+            double readSpeed = 0;
+            for (s32 y = 1; y + 1 < argc; y++) {
+                if (!strcasecmp(argv[y], "-c"))
+                    minLevel = maxLevel = std::max<s32>(JKRCompressionLevel_STORE, std::min<s32>(atoi(argv[y + 1]), JKRCompressionLevel_MAX));
+
+                if (!strcasecmp(argv[y], "--finder"))
+                    context.mFinderType = getFinderType(argv[y + 1]);
+
+                if (!strcasecmp(argv[y], "--match-penalty"))
+                    context.mMatchPenalty = atoi(argv[y + 1]);
+
+                if (!strcasecmp(argv[y], "--read-speed"))
+                    readSpeed = atof(argv[y + 1]);
+            }
+
+            if (!runBenchmark(filePath, minLevel, maxLevel, context, readSpeed)) {
+                printf("Fatal error! Not every level round trips\n");
+                return 1;
+            }
+            i++;
         }
         else if (!strcasecmp(argv[i], "-p") || !strcasecmp(argv[i], "--pack")) {
             std::string filePath = argv[i + 1];
@@ -64,9 +434,17 @@ int main(int argc, char* argv[]) {
     
             JKRCompressionType compType = JKRCompressionType_NONE;
             JKRFileAttr attr = JKRFileAttr_FILE;
-            bool fast = false;
+            s32 level = -1;
+            u32 threadCount = 0;
             bool optimise = false;
+            bool writeIndex = false;
             std::string outputPath = filePath + ".arc";
+            std::string cachePath = "";
+            u64 cacheSize = 1024;
+            JKRMatchFinderType finderType = JKRMatchFinderType_SUFFIX_ARRAY;
+            u32 matchPenalty = 0;
+            double timeBudget = 0;
+            u32 effort = 0;
 
             for (s32 i = 1; i < argc; i++) {
                 if (!strcasecmp(argv[i], "-szs")) 
@@ -75,11 +453,41 @@ int main(int argc, char* argv[]) {
                     compType = JKRCompressionType_SZP;
                 
                 if (!strcasecmp(argv[i], "-f") || !strcasecmp(argv[i], "--fast"))
-                    fast = true;
+                    level = JKRCompressionLevel_FAST;
+
+                if (!strcasecmp(argv[i], "-best"))
+                    level = JKRCompressionLevel_MAX;
+
+                if (!strcasecmp(argv[i], "-c") && i + 1 < argc)
+                    level = atoi(argv[i + 1]);
+
+                if (!strcasecmp(argv[i], "-j") && i + 1 < argc)
+                    threadCount = atoi(argv[i + 1]);
+
+                if (!strcasecmp(argv[i], "--finder") && i + 1 < argc)
+                    finderType = getFinderType(argv[i + 1]);
+
+                if (!strcasecmp(argv[i], "--match-penalty") && i + 1 < argc)
+                    matchPenalty = atoi(argv[i + 1]);
+
+                if (!strcasecmp(argv[i], "--time-budget") && i + 1 < argc)
+                    timeBudget = atof(argv[i + 1]);
+
+                if (!strcasecmp(argv[i], "--effort") && i + 1 < argc)
+                    effort = atoi(argv[i + 1]);
 
                 if (!strcasecmp(argv[i], "-Os"))
                     optimise = true;
 
+                if (!strcasecmp(argv[i], "-idx"))
+                    writeIndex = true;
+
+                if (!strcasecmp(argv[i], "--cache") && i + 1 < argc)
+                    cachePath = argv[i + 1];
+
+                if (!strcasecmp(argv[i], "--cache-size") && i + 1 < argc)
+                    cacheSize = strtoull(argv[i + 1], nullptr, 10);
+
                 if (!strcasecmp(argv[i], "-o") || !strcasecmp(argv[i], "--out")) {
                     u32 lastSlashIdx = outputPath.rfind('\\');
                     std::string name = outputPath.substr(lastSlashIdx + 1);
@@ -100,6 +508,8 @@ int main(int argc, char* argv[]) {
                             attr = (JKRFileAttr)(attr | JKRFileAttr_COMPRESSED);
                             attr = (JKRFileAttr)(attr | JKRFileAttr_USE_SZS);
                         }
+                        else if (!strcasecmp(argv[y], "szp"))
+                            attr = (JKRFileAttr)(attr | JKRFileAttr_COMPRESSED);
                     }
                 }
             }
@@ -107,15 +517,45 @@ int main(int argc, char* argv[]) {
             if (attr == JKRFileAttr_FILE)
                 attr = (JKRFileAttr)(attr | JKRFileAttr_LOAD_TO_MRAM);
 
+            std::shared_ptr<JKRCompressionCache> cache = nullptr;
+            if (!cachePath.empty())
+                cache = std::make_shared<JKRCompressionCache>(cachePath, cacheSize * 1024 * 1024);
+
             JKRArchive* archive = new JKRArchive();
+            archive->mCompressionCache = cache;
+            archive->mCompressionContext->mFinderType = finderType;
+            archive->mCompressionContext->mMatchPenalty = matchPenalty;
+            if (level != -1)
+                archive->mCompressionLevel = level;
             archive->importFromFolder(filePath, attr);
-            archive->save(outputPath, optimise);
-            delete archive;
 
             if (compType != JKRCompressionType_NONE) {
+                // Serialize into memory and compress from there, the output is only written once
+                std::vector<u8> data = archive->saveToMemory(optimise);
                 printf("Compressing!\n");
-                JKRCompression::encode(outputPath, compType, fast);
+
+                if (timeBudget > 0 || effort) {
+                    u32 size;
+                    const u8* dst = JKRCompression::encodeWithBudget(data.data(), data.size(), &size, compType, timeBudget, effort, threadCount, archive->mCompressionContext.get());
+                    File::writeAllBytes(outputPath, dst, size);
+                    delete [] dst;
+                }
+                else
+                    JKRCompression::encode(outputPath, data.data(), data.size(), compType, level == -1 ? JKRCompressionLevel_DEFAULT : level, cache.get(), threadCount, archive->mCompressionContext.get());
+
+                // The uncompressed image is still at hand, so only the token lengths need parsing
+                if (writeIndex && compType == JKRCompressionType_SZS) {
+                    u32 size;
+                    u8* pData = File::readAllBytes(outputPath, &size);
+                    JKRSZSIndex index;
+                    if (index.build(pData, size, data.data()))
+                        index.save(JKRSZSIndex::getSidecarPath(outputPath));
+                    delete [] pData;
+                }
             }
+            else
+                archive->save(outputPath, optimise);
+            delete archive;
         }
     }
     printf("Complete!");
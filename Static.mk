@@ -1,4 +1,4 @@
-CPPFILES := Source\BinaryReaderAndWriter.cpp Source\JKRArchive.cpp Source\Util.cpp Source\JKRCompression.cpp
+CPPFILES := Source\BinaryReaderAndWriter.cpp Source\JKRArchive.cpp Source\Util.cpp Source\JKRCompression.cpp Source\JKRCompressionCache.cpp Source\JKRMatchFinder.cpp Source\JKRSZSStream.cpp Source\JKRSZSIndex.cpp Source\JKRSuffixMatchFinder.cpp Source\JKRArchiveView.cpp
 
 TARGET := JKRArchiveTool.a
 